@@ -0,0 +1,130 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * time_manager.h: Define the clock that decides how long each search may run
+ *
+ * the budget of a game is given by the agent options timeout= (seconds per move) and total_time=
+ * (seconds per game), or by the GTP commands time_settings and time_left;
+ * a game clock is split over the moves still expected, the midgame gets a larger share,
+ * the opening and the endgame get less, and a forced move gets nothing;
+ * a search may also be interrupted from another thread, which is how pondering is stopped
+ */
+
+#pragma once
+#include <chrono>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include "board.h"
+
+class time_manager {
+public:
+	typedef std::chrono::steady_clock clock;
+
+	time_manager(double timeout = 0, double total = 0) : timeout(timeout), total(total), left(total), byo_yomi(0),
+		started(clock::now()), deadline(clock::time_point::max()), interrupted(false) {}
+
+	/**
+	 * GTP time_settings: main time per game and the byo-yomi period, in seconds
+	 */
+	void set_time_settings(double main_time, double byo_yomi_time, int byo_yomi_stones) {
+		total = left = main_time;
+		byo_yomi = byo_yomi_stones > 0 ? byo_yomi_time / byo_yomi_stones : 0;
+	}
+
+	/**
+	 * GTP time_left: the remaining main time, or the time for the remaining stones of the byo-yomi period
+	 */
+	void set_time_left(double time, int stones) {
+		if (stones > 0) {
+			left = 0;
+			byo_yomi = time / stones;
+		} else {
+			left = time;
+			if (total <= 0) total = time; // no time_settings, take this as the main time
+		}
+	}
+
+	/**
+	 * start a new game with the full main time
+	 */
+	void reset() { left = total; }
+
+	/**
+	 * whether the search is limited by time at all
+	 */
+	bool bounded() const { return timeout > 0 || total > 0 || byo_yomi > 0; }
+
+	/**
+	 * start the clock for a move at given state and set its deadline
+	 */
+	void start(const board& state) {
+		started = clock::now();
+		interrupted.store(false, std::memory_order_relaxed);
+		if (!bounded()) {
+			deadline = clock::time_point::max();
+			return;
+		}
+		double budget = std::numeric_limits<double>::max();
+		if (total > 0 || byo_yomi > 0) {
+			budget = (left > 0 ? share(state) : byo_yomi) - lag;
+		}
+		if (timeout > 0) {
+			budget = std::min(budget, timeout);
+		}
+		budget = std::max(budget, 0.0);
+		deadline = started + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(budget));
+	}
+
+	/**
+	 * stop the clock after the move is decided, and charge the time to the main time
+	 */
+	void stop() {
+		if (total > 0) left = std::max(left - elapsed(), 0.0);
+	}
+
+	/**
+	 * make the running search expire at its next check, may be called from another thread
+	 */
+	void interrupt() { interrupted.store(true, std::memory_order_relaxed); }
+
+	bool expired() const { return interrupted.load(std::memory_order_relaxed) || clock::now() >= deadline; }
+	double elapsed() const { return std::chrono::duration<double>(clock::now() - started).count(); }
+
+	/**
+	 * how many more iterations the search can still do before the deadline at its rate so far,
+	 * given that it has done (done) iterations and may do at most (limit) iterations (0 for no limit)
+	 */
+	long remaining(long done, long limit = 0) const {
+		long rest = limit > 0 ? limit - done : std::numeric_limits<long>::max();
+		if (deadline == clock::time_point::max() || done == 0) return rest;
+		double spent = elapsed(), until = std::chrono::duration<double>(deadline - clock::now()).count();
+		if (until <= 0) return 0;
+		if (spent <= 0) return rest;
+		return std::min(rest, long(done * (until / spent)));
+	}
+
+private:
+	/**
+	 * the share of the main time for a move, the game ends when a side has no legal move,
+	 * so about half of the moves still legal for both sides will be ours
+	 */
+	double share(const board& state) const {
+		unsigned who = state.info().who_take_turns;
+		int mine = state.legal_moves(who).count(), theirs = state.legal_moves(3u - who).count();
+		if (mine <= 1) return 0; // forced
+		double moves = std::max(std::min(mine, theirs) / 2.0, 4.0);
+		int empty = state.empties().count();
+		double weight = empty > 54 ? 0.75 : empty > 24 ? 1.5 : 0.5; // opening, midgame, endgame
+		return left * std::min(weight / moves, 0.5);
+	}
+
+	static constexpr double lag = 0.05; // seconds kept for the communication of each move
+
+	double timeout;
+	double total;
+	double left;
+	double byo_yomi; // seconds per move in the byo-yomi period
+	clock::time_point started;
+	clock::time_point deadline;
+	std::atomic<bool> interrupted;
+};
@@ -0,0 +1,78 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * bitboard.h: Define a packed set of up to 128 board points
+ *
+ * the 9x9 board only needs 81 bits, bit (i) stands for the point of 1-d index (i),
+ * so a set of points fits into two machine words and is copied and compared as such
+ */
+
+#pragma once
+#include <cstdint>
+
+class bitboard {
+public:
+	typedef uint64_t word;
+	constexpr bitboard(word lo = 0, word hi = 0) : lo(lo), hi(hi) {}
+	bitboard(const bitboard& b) = default;
+	bitboard& operator =(const bitboard& b) = default;
+
+	static bitboard bit(int i) { return i < 64 ? bitboard(word(1) << i, 0) : bitboard(0, word(1) << (i - 64)); }
+
+public:
+	bool test(int i) const { return i < 64 ? (lo >> i) & 1 : (hi >> (i - 64)) & 1; }
+	void set(int i) { if (i < 64) lo |= word(1) << i; else hi |= word(1) << (i - 64); }
+	void reset(int i) { if (i < 64) lo &= ~(word(1) << i); else hi &= ~(word(1) << (i - 64)); }
+
+	int count() const { return __builtin_popcountll(lo) + __builtin_popcountll(hi); }
+	bool any() const { return lo | hi; }
+	bool none() const { return !any(); }
+	explicit operator bool() const { return any(); }
+
+	/**
+	 * index of the lowest set bit, or -1 if the set is empty
+	 */
+	int first() const {
+		if (lo) return __builtin_ctzll(lo);
+		if (hi) return __builtin_ctzll(hi) + 64;
+		return -1;
+	}
+	int pop_first() {
+		int i = first();
+		if (lo) lo &= lo - 1;
+		else hi &= hi - 1;
+		return i;
+	}
+
+	/**
+	 * index of the n-th (0-based) set bit, or -1 if there are not enough bits
+	 */
+	int nth(int n) const {
+		int low = __builtin_popcountll(lo), base = 0;
+		word w = lo;
+		if (n >= low) w = hi, base = 64, n -= low;
+		for (; n > 0 && w; n--) w &= w - 1;
+		return w ? __builtin_ctzll(w) + base : -1;
+	}
+
+public:
+	bitboard operator &(const bitboard& b) const { return bitboard(lo & b.lo, hi & b.hi); }
+	bitboard operator |(const bitboard& b) const { return bitboard(lo | b.lo, hi | b.hi); }
+	bitboard operator ^(const bitboard& b) const { return bitboard(lo ^ b.lo, hi ^ b.hi); }
+	bitboard operator ~() const { return bitboard(~lo, ~hi); }
+	bitboard& operator &=(const bitboard& b) { lo &= b.lo; hi &= b.hi; return *this; }
+	bitboard& operator |=(const bitboard& b) { lo |= b.lo; hi |= b.hi; return *this; }
+	bitboard& operator ^=(const bitboard& b) { lo ^= b.lo; hi ^= b.hi; return *this; }
+
+	/**
+	 * shift the whole set by n (0 < n < 64) positions
+	 */
+	bitboard operator <<(int n) const { return bitboard(lo << n, (hi << n) | (lo >> (64 - n))); }
+	bitboard operator >>(int n) const { return bitboard((lo >> n) | (hi << (64 - n)), hi >> n); }
+
+	bool operator ==(const bitboard& b) const { return lo == b.lo && hi == b.hi; }
+	bool operator !=(const bitboard& b) const { return !(*this == b); }
+	bool operator < (const bitboard& b) const { return hi != b.hi ? hi < b.hi : lo < b.lo; }
+
+private:
+	word lo, hi;
+};
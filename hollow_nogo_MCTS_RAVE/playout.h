@@ -0,0 +1,68 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * playout.h: Define the random playout engine used by the MCTS agents
+ *
+ * a playout plays uniformly random legal moves for both sides until the side to move
+ * has no legal move left, which loses the game; the legal moves are taken from the masks
+ * maintained by board and a move is drawn from them with a single bounded random number,
+ * so a playout does no allocation and never tries an illegal move
+ */
+
+#pragma once
+#include <chrono>
+#include "board.h"
+#include "rng.h"
+
+class playout {
+public:
+	playout() : games(0), since(clock::now()) {}
+
+	/**
+	 * play the position out randomly and return the winner (board::black or board::white)
+	 */
+	unsigned operator ()(board b, rng& engine) {
+		games++;
+		while (true) {
+			unsigned who = b.info().who_take_turns;
+			const bitboard& legal = b.legal_moves(who);
+			int n = legal.count();
+			if (n == 0) return 3u - who;
+			int i = legal.nth(engine.below(n));
+			b.place(board::point(i), who);
+		}
+	}
+
+	/**
+	 * the same playout that also records the points played by each side into played[who - 1],
+	 * for all-moves-as-first (AMAF) statistics
+	 */
+	unsigned operator ()(board b, rng& engine, bitboard (&played)[2]) {
+		games++;
+		while (true) {
+			unsigned who = b.info().who_take_turns;
+			const bitboard& legal = b.legal_moves(who);
+			int n = legal.count();
+			if (n == 0) return 3u - who;
+			int i = legal.nth(engine.below(n));
+			b.place(board::point(i), who);
+			played[who - 1].set(i);
+		}
+	}
+
+public:
+	/**
+	 * number of playouts and playouts per second since the last reset
+	 */
+	size_t count() const { return games; }
+	double rate() const {
+		double sec = std::chrono::duration<double>(clock::now() - since).count();
+		return sec > 0 ? games / sec : 0;
+	}
+	void reset() { games = 0; since = clock::now(); }
+	playout& operator +=(const playout& p) { games += p.games; return *this; }
+
+private:
+	typedef std::chrono::steady_clock clock;
+	size_t games;
+	clock::time_point since;
+};
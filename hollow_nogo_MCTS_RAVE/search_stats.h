@@ -0,0 +1,131 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * search_stats.h: Define the telemetry of a search
+ *
+ * a search counts its iterations, the depth of the selected paths and the nodes it adds,
+ * and times the select, expand, simulate and backpropagate phases of every iteration;
+ * the agent completes the record with the wall time and the arena usage, and reports it
+ * through the GTP command search_stats and an optional JSON-lines log (stats_log=<path>)
+ */
+
+#pragma once
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstddef>
+
+class search_stats {
+public:
+	typedef std::chrono::steady_clock clock;
+	enum phase { select, expand, simulate, backpropagate, phases };
+
+	search_stats() { reset(); }
+
+	void reset() {
+		iterations = 0;
+		max_depth = 0;
+		depth_sum = 0;
+		nodes = 0;
+		unshared = 0;
+		arena_used = 0;
+		arena_reserved = 0;
+		seconds = 0;
+		std::fill(time, time + phases, 0.0);
+	}
+
+	/**
+	 * start timing an iteration, then close each of its phases in order with lap()
+	 */
+	void begin() { last = clock::now(); }
+	void lap(phase p) {
+		clock::time_point now = clock::now();
+		time[p] += std::chrono::duration<double>(now - last).count();
+		last = now;
+	}
+
+	/**
+	 * count a finished iteration whose path ended at (depth), and that added a node if (expanded)
+	 */
+	void iteration(int depth, bool expanded) {
+		iterations++;
+		max_depth = std::max(max_depth, depth);
+		depth_sum += depth;
+		nodes += expanded;
+	}
+
+	/**
+	 * add the record of another thread, the phase times become thread seconds
+	 */
+	search_stats& operator +=(const search_stats& s) {
+		iterations += s.iterations;
+		max_depth = std::max(max_depth, s.max_depth);
+		depth_sum += s.depth_sum;
+		nodes += s.nodes;
+		unshared += s.unshared;
+		arena_used += s.arena_used;
+		arena_reserved += s.arena_reserved;
+		for (int p = 0; p < phases; p++) time[p] += s.time[p];
+		return *this;
+	}
+
+	double rate() const { return seconds > 0 ? iterations / seconds : 0; }
+	double average_depth() const { return iterations ? double(depth_sum) / iterations : 0; }
+
+	/**
+	 * one line per value, for the GTP reply
+	 */
+	std::string text() const {
+		std::ostringstream out;
+		out << "iterations " << iterations << "\n"
+		    << "seconds " << seconds << "\n"
+		    << "iterations/sec " << rate() << "\n"
+		    << "max_depth " << max_depth << "\n"
+		    << "avg_depth " << average_depth() << "\n"
+		    << "nodes " << nodes << "\n"
+		    << "unshared " << unshared << "\n"
+		    << "arena_used " << arena_used << "\n"
+		    << "arena_reserved " << arena_reserved << "\n"
+		    << "select " << time[select] << "\n"
+		    << "expand " << time[expand] << "\n"
+		    << "simulate " << time[simulate] << "\n"
+		    << "backpropagate " << time[backpropagate];
+		return out.str();
+	}
+
+	/**
+	 * one JSON object of the search for the move played by (player)
+	 */
+	std::string json(const std::string& player, const std::string& move) const {
+		std::ostringstream out;
+		out << "{\"player\":\"" << player << "\",\"move\":\"" << move << "\""
+		    << ",\"iterations\":" << iterations
+		    << ",\"seconds\":" << seconds
+		    << ",\"iterations_per_sec\":" << rate()
+		    << ",\"max_depth\":" << max_depth
+		    << ",\"avg_depth\":" << average_depth()
+		    << ",\"nodes\":" << nodes
+		    << ",\"unshared\":" << unshared
+		    << ",\"arena_used\":" << arena_used
+		    << ",\"arena_reserved\":" << arena_reserved
+		    << ",\"select\":" << time[select]
+		    << ",\"expand\":" << time[expand]
+		    << ",\"simulate\":" << time[simulate]
+		    << ",\"backpropagate\":" << time[backpropagate] << "}";
+		return out.str();
+	}
+
+public:
+	long iterations;
+	int max_depth;
+	long depth_sum;
+	long nodes; // nodes added to the tree
+	long unshared; // positions the transposition table had no room to share, see transposition::failures()
+	size_t arena_used; // bytes of the tree after the search
+	size_t arena_reserved;
+	double seconds; // wall time of the search
+	double time[phases]; // seconds spent in each phase
+
+private:
+	clock::time_point last;
+};
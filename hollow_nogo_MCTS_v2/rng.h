@@ -0,0 +1,89 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * rng.h: Define the pseudo random number generator used by the search
+ *
+ * xoshiro256** (Blackman and Vigna) seeded through splitmix64, a few shifts and xors per number;
+ * below(n) draws an unbiased integer in [0, n) with one multiplication (Lemire's method),
+ * and jump() skips 2^128 numbers ahead, which splits one seed into non-overlapping streams for threads;
+ * it also meets the requirements of a standard uniform random bit generator
+ */
+
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+class rng {
+public:
+	typedef uint64_t result_type;
+
+	rng(uint64_t seed = 0) { this->seed(seed); }
+
+	void seed(uint64_t seed) {
+		for (int i = 0; i < 4; i++) {
+			uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			s[i] = z ^ (z >> 31);
+		}
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator ()() {
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	/**
+	 * a uniform integer in [0, n), n > 0
+	 */
+	uint32_t below(uint32_t n) {
+		uint64_t m = uint64_t((*this)() >> 32) * n;
+		if (uint32_t(m) < n) {
+			uint32_t threshold = uint32_t(-n) % n;
+			while (uint32_t(m) < threshold) m = uint64_t((*this)() >> 32) * n;
+		}
+		return uint32_t(m >> 32);
+	}
+
+	/**
+	 * shuffle [first, last) in place (Fisher-Yates)
+	 */
+	template<typename iterator>
+	void shuffle(iterator first, iterator last) {
+		for (uint32_t n = last - first; n > 1; n--) {
+			std::swap(first[n - 1], first[below(n)]);
+		}
+	}
+
+	/**
+	 * advance the state by 2^128 numbers
+	 */
+	void jump() {
+		static const uint64_t poly[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+		uint64_t t[4] = {};
+		for (uint64_t p : poly) {
+			for (int b = 0; b < 64; b++) {
+				if (p & (uint64_t(1) << b)) {
+					for (int i = 0; i < 4; i++) t[i] ^= s[i];
+				}
+				(*this)();
+			}
+		}
+		for (int i = 0; i < 4; i++) s[i] = t[i];
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	uint64_t s[4];
+};
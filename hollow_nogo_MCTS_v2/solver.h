@@ -0,0 +1,129 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * solver.h: Define the exact endgame solver
+ *
+ * a depth-first proof search (negamax with alpha-beta on win/loss values) for the side to move,
+ * a side without legal moves has lost and there are no draws, so a position is won if some move
+ * leads to a lost position; the moves that leave the opponent the fewest legal moves are tried first,
+ * proven positions are kept in a transposition table keyed by the zobrist hash, and a search that
+ * visits more positions than its budget (including those made to order the moves) or runs past
+ * the deadline of its timer gives up and reports the position as unknown
+ */
+
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "board.h"
+#include "time_manager.h"
+
+class solver {
+public:
+	enum result { lost = -1, unknown = 0, won = 1 };
+
+	solver(int bits = 18) : mask((size_t(1) << bits) - 1), table(mask + 1), budget(0), visited(0), check(0), timer(nullptr) {}
+
+	/**
+	 * solve state within a budget of positions and before timer expires, return won or lost for the side to move,
+	 * or unknown; (move) gets a winning move if the position is won
+	 */
+	result solve(const board& state, long limit, const time_manager& timer, int& move) {
+		budget = limit;
+		visited = 0;
+		check = interval;
+		this->timer = &timer;
+		return search(state, move);
+	}
+
+	/**
+	 * positions visited by the last solve
+	 */
+	long nodes() const { return visited; }
+
+	/**
+	 * forget all proven positions, the proofs stay valid during a game so this is only needed between games
+	 */
+	void clear() { std::fill(table.begin(), table.end(), entry()); }
+
+private:
+	struct entry {
+		uint64_t key = 0;
+		int result = unknown;
+		int move = -1; // the winning move of a won position
+	};
+
+	/**
+	 * count a visited position, false if the budget is spent or the timer has expired
+	 */
+	bool visit() {
+		if (++visited > budget) return false;
+		if (visited < check) return true;
+		check = visited + interval;
+		return !timer->expired();
+	}
+
+	result search(const board& b, int& move) {
+		if (!visit()) return unknown;
+		uint64_t key = b.hash();
+		entry& e = table[key & mask];
+		if (e.key == key && e.result != unknown) {
+			move = e.move;
+			return result(e.result);
+		}
+
+		unsigned who = b.info().who_take_turns, opp = 3u - who;
+		bitboard legal = b.legal_moves(who);
+		if (legal.none()) return store(key, lost, -1);
+
+		// order the moves by the number of legal moves left to the opponent, fewest first
+		int moves[board::size_x * board::size_y], score[board::size_x * board::size_y], n = 0;
+		while (legal) {
+			int m = legal.pop_first();
+			if (!visit()) return unknown;
+			board after = b;
+			after.place(board::point(m), who);
+			int s = after.legal_moves(opp).count();
+			if (s == 0) {
+				move = m;
+				return store(key, won, m);
+			}
+			int k = n++;
+			for (; k > 0 && score[k - 1] > s; k--) {
+				moves[k] = moves[k - 1];
+				score[k] = score[k - 1];
+			}
+			moves[k] = m;
+			score[k] = s;
+		}
+
+		for (int k = 0; k < n; k++) {
+			board after = b;
+			after.place(board::point(moves[k]), who);
+			int reply;
+			result r = search(after, reply);
+			if (r == unknown) return unknown;
+			if (r == lost) {
+				move = moves[k];
+				return store(key, won, moves[k]);
+			}
+		}
+		return store(key, lost, -1);
+	}
+
+	result store(uint64_t key, result r, int move) {
+		entry& e = table[key & mask];
+		e.key = key;
+		e.result = r;
+		e.move = move;
+		return r;
+	}
+
+	size_t mask;
+	std::vector<entry> table;
+	static const long interval = 256; // positions between two looks at the timer
+	long budget;
+	long visited;
+	long check; // the timer is looked at when this many positions are visited
+	const time_manager* timer;
+};
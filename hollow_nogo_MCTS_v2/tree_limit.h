@@ -0,0 +1,58 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * tree_limit.h: Define the memory bound of a search tree
+ *
+ * max_nodes=<nodes> and max_mem=<megabytes> bound the tree of an agent (0 for no bound);
+ * a full tree is no longer expanded and the playouts keep refining the nodes already in it,
+ * and the subtree kept for the next search is pruned of its least visited moves until it fits
+ * in half of the bound, so that the next search has room to grow
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include "arena.h"
+
+class tree_limit {
+public:
+	tree_limit(long nodes = 0, double megabytes = 0) : nodes(std::max(nodes, 0L)), bytes(std::max(megabytes, 0.0) * (1 << 20)) {}
+
+	bool bounded() const { return nodes > 0 || bytes > 0; }
+
+	/**
+	 * whether the tree in pool has reached the bound
+	 */
+	bool full(const arena& pool) const {
+		return (nodes > 0 && pool.count() >= size_t(nodes)) || (bytes > 0 && pool.used() >= bytes);
+	}
+
+	/**
+	 * a fraction f of the bound, e.g. the share of one of several trees
+	 */
+	tree_limit part(double f) const {
+		tree_limit t;
+		t.nodes = nodes > 0 ? std::max(long(nodes * f), 1L) : 0;
+		t.bytes = bytes > 0 ? std::max(size_t(bytes * f), size_t(1)) : 0;
+		return t;
+	}
+
+	/**
+	 * what is left of the bound after the tree in pool, and the bound raised by the tree in pool
+	 */
+	tree_limit less(const arena& pool) const {
+		tree_limit t;
+		t.nodes = nodes > 0 ? std::max(nodes - long(pool.count()), 1L) : 0;
+		t.bytes = bytes > 0 ? std::max(bytes - std::min(pool.used(), bytes), size_t(1)) : 0;
+		return t;
+	}
+	tree_limit above(const arena& pool) const {
+		tree_limit t;
+		t.nodes = nodes > 0 ? nodes + pool.count() : 0;
+		t.bytes = bytes > 0 ? bytes + pool.used() : 0;
+		return t;
+	}
+
+private:
+	long nodes;
+	size_t bytes;
+};
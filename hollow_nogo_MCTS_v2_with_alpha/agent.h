@@ -14,13 +14,27 @@
 #include <map>
 #include <type_traits>
 #include <algorithm>
+#include <thread>
+#include <unordered_map>
 #include "board.h"
 #include "action.h"
+#include "rng.h"
+#include "playout.h"
+#include "arena.h"
+#include "transposition.h"
+#include "time_manager.h"
+#include "solver.h"
+#include "search_stats.h"
+#include "tree_limit.h"
 #include <fstream>
-#include <queue>
+#include <iostream>
 #include <torch/torch.h>
 #include "neural/network.h"
+#include "neural/inference.h"
 #include "stateTorch.h"
+#include "batch_queue.h"
+#include "puct.h"
+#include "eval_cache.h"
 
 class agent {
 public:
@@ -37,6 +51,8 @@ public:
 	virtual void close_episode(const std::string& flag = "") {}
 	virtual action take_action(const board& b, int result) { return action(); }
 	virtual bool check_for_win(const board& b) { return false; }
+	virtual void ponder(const board& b) {}
+	virtual void stop_pondering() {}
 
 public:
 	virtual std::string property(const std::string& key) const { return meta.at(key); }
@@ -70,7 +86,7 @@ public:
 	virtual ~random_agent() {}
 
 protected:
-	std::default_random_engine engine;
+	rng engine;
 };
 
 /**
@@ -79,8 +95,8 @@ protected:
  */
 class player : public random_agent {
 public:
-	player(const std::string& args = "") : random_agent("name=random role=unknown N=0 " + args),
-		space(board::size_x * board::size_y), who(board::empty) {
+	player(const std::string& args = "") : random_agent("name=random role=unknown N=0 verbose=0 timeout=0 total_time=0 ponder=0 solve=20 solve_budget=500000 stats_log= max_nodes=0 max_mem=0 " + args),
+		space(board::size_x * board::size_y), who(board::empty), timer(meta["timeout"], meta["total_time"]), ponder_timer(meta["ponder"]), limit(meta["max_nodes"], meta["max_mem"]) {
 		if (name().find_first_of("[]():; ") != std::string::npos)
 			throw std::invalid_argument("invalid name: " + name());
 		if (role() == "black") who = board::black;
@@ -90,14 +106,114 @@ public:
 		for (size_t i = 0; i < space.size(); i++)
 			space[i] = action::place(i, who);
 	}
+	virtual ~player() { stop_pondering(); }
 	
+	virtual void notify(const std::string& msg) {
+		// time_settings=<main time> <byo-yomi time> <byo-yomi stones> and time_left=<time> <stones> from GTP
+		std::string key = msg.substr(0, msg.find('='));
+		std::istringstream in(msg.substr(msg.find('=') + 1));
+		if (key == "time_settings") {
+			double main_time = 0, byo_yomi_time = 0;
+			int byo_yomi_stones = 0;
+			in >> main_time >> byo_yomi_time >> byo_yomi_stones;
+			timer.set_time_settings(main_time, byo_yomi_time, byo_yomi_stones);
+		} else if (key == "time_left") {
+			double time = 0;
+			int stones = 0;
+			in >> time >> stones;
+			timer.set_time_left(time, stones);
+		} else {
+			random_agent::notify(msg);
+		}
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		// the tree is only kept within a game
+		timer.reset();
+		endgame.clear();
+		pool.reset();
+		table.clear();
+		tree = nullptr;
+	}
+
+	/**
+	 * keep searching in the background from state, the position after our move, until the opponent replies;
+	 * ponder=<seconds> bounds such a search (0 for no pondering), and the next search takes over
+	 * the subtree of the move the opponent actually plays
+	 */
+	virtual void ponder(const board& state) {
+		stop_pondering();
+		if(!ponder_timer.bounded() || state.legal_moves(state.info().who_take_turns).count() == 0){
+			return;
+		}
+		bool verbose = int(meta["verbose"]);
+		ponder_timer.start(state);
+		ponder_thread = std::thread([this, state, verbose](){
+			node* root = reuse_root(state, tree, pool, spare, table, limit);
+			playout pondered;
+			search_stats unused;
+			root->MCTS(0, engine, pondered, pool, table, limit, ponder_timer, unused);
+			if(verbose){
+				std::cerr << "pondered playouts = " << pondered.count() << ", seconds = " << ponder_timer.elapsed() << std::endl;
+			}
+		});
+	}
+
+	virtual void stop_pondering() {
+		if(ponder_thread.joinable()){
+			ponder_timer.interrupt();
+			ponder_thread.join();
+		}
+	}
+
+	/**
+	 * complete the statistics of the last search, which played move (-1 for none), and append them
+	 * to stats_log=<path> as one JSON object per line if a path is given
+	 */
+	void record(int move){
+		stats.seconds = timer.elapsed();
+		stats.arena_used = pool.used();
+		stats.arena_reserved = pool.reserved() + spare.reserved();
+		std::string path = meta["stats_log"];
+		if(path.size()){
+			std::ofstream log(path, std::ios::app);
+			log << stats.json(name(), move != -1 ? std::string(board::point(move)) : "resign") << std::endl;
+		}
+	}
+
+	virtual std::string property(const std::string& key) const {
+		// search_stats is the telemetry of the last search
+		if(key == "search_stats"){
+			return stats.text();
+		}
+		return random_agent::property(key);
+	}
+
+	/**
+	 * a winning move found by the exact endgame solver once the side to move has at most solve=<moves> legal moves,
+	 * or -1 if the position is lost or not solved within solve_budget=<positions> and the time of the move,
+	 * then MCTS takes over
+	 */
+	int solve_endgame(const board& state){
+		if(state.legal_moves(state.info().who_take_turns).count() > int(meta["solve"])){
+			return -1;
+		}
+		int move = -1;
+		solver::result result = endgame.solve(state, meta["solve_budget"], timer, move);
+		if(int(meta["verbose"])){
+			const char* name[] = { "lost", "unknown", "won" };
+			std::cerr << "solver = " << name[result + 1] << ", positions = " << endgame.nodes() << std::endl;
+		}
+		return result == solver::won ? move : -1;
+	}
+
 	virtual action take_action(const board& state, int result) {
 		
 		if (result != -1) {
 			if (board(state).place(result) == board::legal) {
 				return action::place(result, state.info().who_take_turns);
 			} else {
-				std::shuffle(space.begin(), space.end(), engine);
+				engine.shuffle(space.begin(), space.end());
 				for (const action::place& move : space) {
 					board after = state;
 					if (move.apply(after) == board::legal)
@@ -107,10 +223,24 @@ public:
 			
 		} else {
 			int N = meta["N"];
-			if(N){
-				node* root = new node(state);
-				int mcts_result = root->MCTS(N, engine);
-				delete_tree(root);
+			if(N || timer.bounded()){
+				timer.start(state);
+				stats.reset();
+				int solved = solve_endgame(state);
+				if(solved != -1){
+					timer.stop();
+					record(solved);
+					return action::place(solved, state.info().who_take_turns);
+				}
+				node* root = reuse_root(state, tree, pool, spare, table, limit);
+				simulator.reset();
+				int mcts_result = root->MCTS(N, engine, simulator, pool, table, limit, timer, stats);
+				stats.unshared = table.failures();
+				timer.stop();
+				record(mcts_result);
+				if(int(meta["verbose"])){
+					std::cerr << "playouts = " << simulator.count() << ", playouts/sec = " << simulator.rate() << ", seconds = " << timer.elapsed() << std::endl;
+				}
 				if(mcts_result != -1){
 					return action::place(mcts_result, state.info().who_take_turns);
 				}else{
@@ -125,56 +255,100 @@ public:
 
 	class node : board {
 	public:
-		int win_cnt;
 		int total_cnt;
-		int place_pos;
-		//std::vector<node*> child;
-		std::unordered_map<int, node*> child;
-		node* parent;
-
-		node(const board& state, int m = -1): board(state), place_pos(m), win_cnt(0), total_cnt(0), parent(nullptr) {}
-
-		float win_rate(){
-			if(total_cnt == 0){
+		int place_pos; // the move by which this position was first reached
+
+		// the proven result for the side to move here (MCTS-Solver): a side without legal moves has lost,
+		// a node is won if some move leads to a lost node, and lost if all moves lead to won nodes
+		enum { lost = -1, unknown = 0, won = 1 };
+		int proof;
+
+		// children live in one block allocated at the first expansion, the legal moves are shuffled once there
+		// and slots [tried, child_cnt) are the untried moves still to be expanded, in that order;
+		// the statistics of slot k are kept by the parent so that the ucb scan only touches these arrays
+		int child_cnt;
+		int tried;
+		int* child_move;
+		int* child_win;
+		int* child_total;
+		node** child;
+
+		node(const board& state, int m = -1): board(state), total_cnt(0), place_pos(m),
+			proof(state.legal_moves(state.info().who_take_turns).any() ? unknown : lost),
+			child_cnt(0), tried(0), child_move(nullptr), child_win(nullptr), child_total(nullptr), child(nullptr) {}
+
+		float win_rate(int k){
+			if(child_total[k] == 0){
 				return 0.0;
 			}
 			
-			return (float)win_cnt / total_cnt;
+			return (float)child_win[k] / child_total[k];
 		}
 
-		float ucb(){
+		int select_child(){
 			float c = 0.5;
-
-			if(parent->total_cnt == 0 || total_cnt == 0){
-				return win_rate();
+			float log_total = total_cnt ? std::log(total_cnt) : 0;
+			float max_score = -std::numeric_limits<float>::max();
+			int best = 0;
+			for(int k = 0; k < child_cnt; ++k){
+				if(child[k]->proof == lost){
+					return k; // a winning move
+				}
+				if(child[k]->proof == won){
+					continue; // a losing move, solved subtrees are not searched any further
+				}
+				float q = child_total[k] ? (float)child_win[k] / child_total[k] : 0;
+				float u = child_total[k] ? c * std::sqrt(log_total / child_total[k]) : 0;
+				float tmp = q + u;
+				if(tmp > max_score){
+					max_score = tmp;
+					best = k;
+				}
 			}
 
-			return win_rate() + c * std::sqrt(std::log(parent->total_cnt) / total_cnt);
+			return best;
 		}
 
-		int MCTS(int N, std::default_random_engine& engine){
+		int MCTS(int N, rng& engine, playout& simulator, arena& pool, transposition<node>& table, const tree_limit& limit, const time_manager& timer, search_stats& stats){
 			// 1. select  2. expand  3. simulate  4. back propagate
 			
-			for(int i = 0; i < N; ++i){
+			for(int i = 0; N == 0 || i < N; ++i){
+				if(proof != unknown){
+					break; // solved, the best move is known
+				}
+				// stop at the deadline, or once the best move is decided (checked every 64 iterations)
+				if(timer.bounded() && i > 0 && i % 64 == 0 && (timer.expired() || decided(timer.remaining(i, N)))){
+					break;
+				}
 				// debug
 				//std::fstream debug("record.txt", std::ios::app);
 
 				// select
 				//debug << "select" << std::endl;
-				std::vector<node*> path = select_root_to_leaf(info().who_take_turns, engine);
+				stats.begin();
+				std::vector<int> slot; // slot[j] is the slot of path[j + 1] in the child block of path[j]
+				std::vector<node*> path = select_root_to_leaf(info().who_take_turns, engine, slot);
+				stats.lap(search_stats::select);
 				// expand
 				//debug << "expand" << std::endl;
 				node* leaf = path.back();
-				node* expand_node = leaf->expand_from_leaf(engine);
-				if(expand_node != leaf){
-					path.push_back(expand_node);
+				// a full tree is not expanded any more, the playout starts from the leaf itself
+				int k = leaf->proof == unknown && !limit.full(pool) ? leaf->expand_from_leaf(engine, pool, table) : -1;
+				if(k != -1){
+					path.push_back(leaf->child[k]);
+					slot.push_back(k);
 				}
+				stats.lap(search_stats::expand);
 				// simulate
 				//debug << "simulate" << std::endl;
-				unsigned winner = path.back()->simulate_winner(engine);
+				// a proven position needs no playout
+				unsigned winner = path.back()->proof != unknown ? path.back()->proven_winner() : path.back()->simulate_winner(engine, simulator);
+				stats.lap(search_stats::simulate);
 				// backpropagate
 				//debug << "backpropagate" << std::endl;
-				back_propagate(path, winner);
+				back_propagate(path, slot, winner);
+				stats.lap(search_stats::backpropagate);
+				stats.iteration(slot.size(), k != -1);
 
 				//debug.close();
 			}
@@ -183,184 +357,406 @@ public:
 		}
 
 		int select_action(){
-			// select child node who has the highest win rate (highest Q)
-			if(child.size() == 0){
+			// select the most visited child (the robust child), which is what decided() settles; ties go to the highest win rate
+			if(tried == 0){
 				return -1;
 			}
 
 			float max_score = -std::numeric_limits<float>::max();
-			node* c;
-			for(auto &ch : child){
-				float tmp = ch.second->win_rate();
-				if(tmp > max_score){
+			int max_visits = -1;
+			int best = -1;
+			bool best_losing = false;
+			for(int k = 0; k < tried; ++k){
+				if(child[k]->proof == lost){
+					return child_move[k]; // wins by force
+				}
+				bool losing = child[k]->proof == won; // a proven losing move is only played when all moves lose
+				float tmp = win_rate(k);
+				bool better = child_total[k] > max_visits || (child_total[k] == max_visits && tmp > max_score);
+				if(best == -1 || (best_losing && !losing) || (losing == best_losing && better)){
 					max_score = tmp;
-					c = ch.second;
+					max_visits = child_total[k];
+					best = k;
+					best_losing = losing;
 				}
 			}
 			
-			return c->place_pos;
+			return child_move[best];
 		}
 
-		std::vector<node*> select_root_to_leaf(unsigned who, std::default_random_engine& engine){
+		std::vector<node*> select_root_to_leaf(unsigned who, rng& engine, std::vector<int>& slot){
 			std::vector<node*> vec;
 			node* curr = this;
 			vec.push_back(curr);
 
-			while(!curr->is_leaf()){
-				// select node who has the highest ucb score
-				float max_score = -std::numeric_limits<float>::max();
-				node* c;
-				if(curr->child.size() == 0){
-					break;
-				}
-				
-				for(auto &curr_child : curr->child){
-					float tmp = curr_child.second->ucb();
-					if(tmp > max_score){
-						max_score = tmp;
-						c = curr_child.second;
-					}
-
-				}
-				
-				vec.push_back(c);
-				curr = c;
+			while(curr->proof == unknown && !curr->is_leaf()){
+				// select child who has the highest ucb score
+				int k = curr->select_child();
+				curr = curr->child[k];
+				vec.push_back(curr);
+				slot.push_back(k);
 			}
 
 			return vec;
 		}
 
-		bool is_leaf(){
-			int cnt = 0;
-			for(int i = 0; i < 81; i++){
-				if(board(*this).place(i) == board::legal){
-					cnt++;
+		bool decided(long remaining){
+			// the most visited move can no longer be overtaken by the iterations still to come
+			int first = 0, second = 0;
+			for(int k = 0; k < tried; ++k){
+				if(child_total[k] > first){
+					second = first;
+					first = child_total[k];
+				}else if(child_total[k] > second){
+					second = child_total[k];
 				}
 			}
+			return first - second > remaining;
+		}
+
+		bool is_leaf(){
 			// check if fully expanded (leaf == not fully expanded)
-			return !(cnt > 0 && child.size() == cnt);
+			return child_cnt == 0 || tried < child_cnt;
 		}
 
-		node* expand_from_leaf(std::default_random_engine& engine){
-			board b;
-			std::vector<int> vec = all_space(engine);
-			bool success_placed = 0;
-			int pos = -1;
-			
-			for(int i = 0; i < vec.size(); ++i){
-				b = *this;
-				if(b.place(vec[i]) == board::legal && (*this).child.count(vec[i]) == 0){
-					pos = vec[i];
-					success_placed = 1;
-					break;
+		unsigned proven_winner() const {
+			return proof == won ? info().who_take_turns : 3u - info().who_take_turns;
+		}
+
+		void solve(){
+			// prove this node from its children, it is lost only once all its moves are expanded and won
+			if(proof != unknown || child == nullptr){
+				return;
+			}
+			bool all_won = tried == child_cnt;
+			for(int k = 0; k < tried; ++k){
+				if(child[k]->proof == lost){
+					proof = won;
+					return;
 				}
+				all_won = all_won && child[k]->proof == won;
 			}
+			if(all_won){
+				proof = lost;
+			}
+		}
 
-			if(success_placed){
-				node* new_node = new node(b, pos);
-				//this->child.push_back(new_node);
-				this->child[pos] = new_node;
-				new_node->parent = this;
-				return new_node;
-			}else{
-				return this;
+		void allocate_children(rng& engine, arena& pool){
+			bitboard legal = legal_moves(info().who_take_turns);
+			child_cnt = legal.count();
+			child_move = pool.make_array<int>(child_cnt);
+			child_win = pool.make_array<int>(child_cnt);
+			child_total = pool.make_array<int>(child_cnt);
+			child = pool.make_array<node*>(child_cnt);
+			for(int k = 0; k < child_cnt; ++k){
+				child_move[k] = legal.pop_first();
 			}
+			engine.shuffle(child_move, child_move + child_cnt);
 		}
 
-		unsigned simulate_winner(std::default_random_engine& engine){
+		int expand_from_leaf(rng& engine, arena& pool, transposition<node>& table){
+			if(child == nullptr){
+				allocate_children(engine, pool);
+			}
+			if(tried == child_cnt){
+				return -1;
+			}
+
+			// pop the next untried move, the position may be already in the tree through another move order
+			int k = tried++;
 			board b = *this;
-			std::vector<int> vec = all_space(engine);
-			std::queue<int> q;
-			for(int i = 0; i < vec.size(); ++i){
-				q.push(vec[i]);
+			b.place(child_move[k]);
+			node* n = table.find(b.hash());
+			if(n == nullptr || !n->same_position(b)){
+				n = pool.make<node>(b, child_move[k]);
+				table.reserve(pool.count()); // the table grows with the tree, only this search uses it
+				table.insert(b.hash(), n);
 			}
+			child[k] = n;
+			return k;
+		}
 
-			int cnt = 0;
-			while(cnt != q.size()){
-				int i = q.front();
-				q.pop();
-				if(b.place(i) != board::legal){
-					q.push(i);
-					cnt++;
-				}else{
-					cnt = 0;
+		bool same_position(const board& b) const {
+			return board::operator ==(b) && info().who_take_turns == b.info().who_take_turns;
+		}
+
+		/**
+		 * the node of state below this one, reached along the moves played since, or nullptr if they leave the tree
+		 */
+		node* descendant(const board& state){
+			// stones are never removed in NoGo, so the moves played since are the stones state has on top of this position
+			node* n = this;
+			while(n != nullptr && !n->same_position(state)){
+				unsigned turn = n->info().who_take_turns;
+				bitboard played = state.stones(turn) & ~n->stones(turn);
+				node* next = nullptr;
+				for(int k = 0; k < n->tried && next == nullptr; ++k){
+					if(played.test(n->child_move[k])){
+						next = n->child[k];
+					}
 				}
+				n = next;
 			}
+			return n;
+		}
 
-			if(b.info().who_take_turns == board::white){
-				return board::black;
-			}else{
-				return board::white;
+		node* copy_to(arena& pool, transposition<node>& table, std::unordered_map<const node*, node*>& copied, int keep = 0){
+			// a node shared by several move orders is copied only once, copied maps the nodes copied so far to their copies;
+			// an unproven move visited fewer than (keep) times is pruned, it is untried again and its subtree is dropped
+			node*& n = copied[this];
+			if(n != nullptr){
+				return n;
+			}
+			n = pool.make<node>(*this);
+			table.insert(hash(), n);
+			if(child != nullptr){
+				n->child_move = pool.make_array<int>(child_cnt);
+				n->child_win = pool.make_array<int>(child_cnt);
+				n->child_total = pool.make_array<int>(child_cnt);
+				n->child = pool.make_array<node*>(child_cnt);
+				std::copy(child_move, child_move + child_cnt, n->child_move);
+				std::copy(child_win, child_win + child_cnt, n->child_win);
+				std::copy(child_total, child_total + child_cnt, n->child_total);
+				std::copy(child, child + tried, n->child);
+				for(int k = tried - 1; k >= 0; --k){
+					if(child_total[k] < keep && child[k]->proof == unknown){
+						// move the pruned slot behind the last tried one
+						int last = --n->tried;
+						std::swap(n->child_move[k], n->child_move[last]);
+						std::swap(n->child_win[k], n->child_win[last]);
+						std::swap(n->child_total[k], n->child_total[last]);
+						std::swap(n->child[k], n->child[last]);
+						n->child_win[last] = n->child_total[last] = 0;
+						n->child[last] = nullptr;
+					}
+				}
+				for(int k = 0; k < n->tried; ++k){
+					n->child[k] = n->child[k]->copy_to(pool, table, copied, keep);
+				}
 			}
+			return n;
 		}
 
-		std::vector<int> all_space(std::default_random_engine& engine){
-			std::vector<int> vec;
-			for(int i = 0; i < 81; ++i){
-				vec.push_back(i);
-			}
-			std::shuffle(vec.begin(), vec.end(), engine);
-			return vec;
+		unsigned simulate_winner(rng& engine, playout& simulator){
+			return simulator(*this, engine);
 		}
 
-		void back_propagate(std::vector<node*>& path, unsigned winner){
-			for(int i = 0; i < path.size(); ++i){
+		void back_propagate(std::vector<node*>& path, std::vector<int>& slot, unsigned winner){
+			for(int i = 0; i < int(path.size()); ++i){
 				path[i]->total_cnt++;
-				if(winner != (path[i]->info()).who_take_turns){
-					path[i]->win_cnt++;
+			}
+			// the statistics of a move are kept in its slot of the parent
+			for(int i = 0; i < int(slot.size()); ++i){
+				node* n = path[i];
+				int k = slot[i];
+				n->child_total[k]++;
+				if(winner != (path[i + 1]->info()).who_take_turns){
+					n->child_win[k]++;
 				} else {
-					path[i]->win_cnt--;
+					n->child_win[k]--;
 				}
 			}
+			// a proven result at the end of the path may prove its ancestors in turn
+			for(int i = int(slot.size()) - 1; i >= 0 && path[i + 1]->proof != unknown; --i){
+				path[i]->solve();
+			}
 		}
 	};
 
-	void delete_tree(node* root){
-		if(root->child.size() == 0){
-			delete root;
-			return ;
+	/**
+	 * the root to search state from, which is taken from the tree of the last search when state is in it;
+	 * it is reached from tree, the root of that search, along the moves played since, and only looked up
+	 * by its hash when they left the tree; that subtree is copied into the spare arena and everything else is released,
+	 * and under a bound the subtree is pruned until it fits in half of limit and the spare chunks are freed;
+	 * tree is set to the new root
+	 */
+	node* reuse_root(const board& state, node*& tree, arena& pool, arena& spare, transposition<node>& table, const tree_limit& limit){
+		node* last = tree != nullptr ? tree->descendant(state) : nullptr;
+		if(last == nullptr){
+			last = table.find(state.hash());
 		}
-
-		for(auto &c : root->child){
-			if(c.second != nullptr){
-				delete_tree(c.second);
+		if(last != nullptr && !last->same_position(state)){
+			last = nullptr;
+		}
+		node* root;
+		std::unordered_map<const node*, node*> copied;
+		table.reserve(pool.count()); // room for the whole last tree, of which a part is copied
+		tree_limit half = limit.part(0.5);
+		for(int keep = 0; ; keep = keep ? keep * 3 / 2 : 2){
+			spare.reset();
+			table.clear();
+			copied.clear();
+			if(last != nullptr){
+				root = last->copy_to(spare, table, copied, keep);
+			}else{
+				root = spare.make<node>(state);
+				table.insert(state.hash(), root);
+			}
+			// prune the moves visited fewer than keep times, raising keep by half until the subtree fits
+			if(last == nullptr || !half.full(spare) || keep > last->total_cnt){
+				break;
 			}
 		}
-
-		delete root;
+		std::swap(pool, spare);
+		if(limit.bounded()){
+			spare.release();
+		}else{
+			spare.reset();
+		}
+		tree = root;
+		return root;
 	}
 
-
 private:
 	std::vector<action::place> space;
 	board::piece_type who;
+	playout simulator;
+	time_manager timer;
+	time_manager ponder_timer; // bounds a background search by ponder=<seconds>
+	tree_limit limit; // bounds the tree by max_nodes=<nodes> and max_mem=<megabytes>
+	solver endgame;
+	search_stats stats; // of the last search
+	arena pool;
+	arena spare; // the kept subtree is copied here before each search
+	node* tree = nullptr; // the root of the last search, in pool
+	transposition<node> table;
+	std::thread ponder_thread;
 };
 
+/**
+ * the policy network that plays the opening, configured by --alpha="key=value ...":
+ * device=auto|cpu|cuda (auto takes cuda when it is available), threads=<n> for the intra-op threads
+ * of CPU inference (0 for one per hardware thread), and weights=<file>;
+ * the move is the most likely legal move of the policy, or with search=puct the most visited move of
+ * a PUCT search of N=<visits> or timeout=<seconds> by search_threads=<n> threads, whose positions are
+ * evaluated in batches of up to batch=<n> that wait at most wait=<milliseconds>, with c_puct=<c>
+ * (the value head is taken as the value for the side to move); the evaluations are cached in a table
+ * of 2^cache_bits entries (0 for no cache), which is kept across the searches of the process;
+ * the network runs with its batch normalizations folded into the convolutions (fold=0 runs it as trained),
+ * and int8=1 quantizes it for CPU inference with the activation ranges of calibration=<n> positions of
+ * random games, printing how often its best move agrees with the float network on another n positions;
+ * at startup, check=<n> positions of random games (0 for none) check the input encoding against the rotated boards
+ * the network was trained with, and the folded network against the network as trained, which is used if they disagree
+ */
 class AlphaGo {
 public:
 	az::AlphaZeroNetwork network = nullptr;
-	AlphaGo () {
+	AlphaGo (const std::string& args = "") : device(torch::kCPU) {
+		std::map<std::string, std::string> meta = { {"device", "auto"}, {"threads", "0"}, {"weights", "epoch110_weights.pt"},
+			{"search", "policy"}, {"N", "800"}, {"timeout", "0"}, {"search_threads", "8"}, {"batch", "8"}, {"wait", "1"}, {"c_puct", "1.5"},
+			{"cache_bits", "16"}, {"fold", "1"}, {"int8", "0"}, {"calibration", "512"}, {"check", "64"} };
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			meta[pair.substr(0, pair.find('='))] = pair.substr(pair.find('=') + 1);
+		}
+		if (meta["device"] == "auto") {
+			meta["device"] = torch::cuda::is_available() ? "cuda" : "cpu";
+		}
+		device = torch::Device(meta["device"]);
+		if (device.is_cpu()) {
+			int threads = std::stoi(meta["threads"]);
+			if (threads <= 0) {
+				threads = std::max(int(std::thread::hardware_concurrency()), 1);
+			}
+			torch::set_num_threads(threads);
+		}
+
+		int checks = std::stoi(meta["check"]); // positions to check the input encoding and the folded network on, 0 for none
+		if (checks > 0) {
+			rng engine(checks);
+			int agreed = 0;
+			for (int i = 0; i < checks; i++) {
+				board a, b, c;
+				play(engine, a, b, c);
+				torch::Tensor x = torch::zeros({1, 7, 9, 9});
+				MovingStates::encode(x.data_ptr<float>(), a, b, c);
+				agreed += x.equal(MovingStates::rotatedTensor(a, b, c));
+			}
+			std::cerr << "input encoding agrees with the rotated boards on " << agreed << " of " << checks << " positions" << std::endl;
+			if (agreed != checks) {
+				throw std::runtime_error("the input encoding does not match the one the network was trained with");
+			}
+		}
+
 		const auto net_op = az::NetworkOptions{7, 9, 9, 128, 2, 81};
 		az::AlphaZeroNetwork net(net_op);
 		network = net;
-		std::string weights_file = "epoch110_weights.pt";
-		torch::load(network, weights_file);
-		network->to(torch::kCUDA);
+		torch::load(network, meta["weights"]);
+		network->to(device);
 		network->eval();
+		if (meta["fold"] != "0" || meta["int8"] == "1") {
+			inference.reset(new az::InferenceNetwork(network));
+		}
+		if (inference && checks > 0) {
+			// folding only regroups the arithmetic, so both networks must agree up to rounding
+			torch::NoGradGuard no_grad;
+			rng engine(checks);
+			torch::Tensor test = sample(checks, engine).to(device);
+			auto [v_ref, p_ref] = network->forward(test);
+			auto [v_fold, p_fold] = inference->forward(test);
+			float diff = std::max((p_ref - p_fold).abs().max().item<float>(), (v_ref - v_fold).abs().max().item<float>());
+			float scale = std::max(p_ref.abs().max().item<float>(), 1.0f);
+			std::cerr << "folded network max difference " << diff << ", policy top-1 agreement " << az::top1_agreement(p_ref, p_fold)
+			          << " on " << checks << " positions" << std::endl;
+			if (diff > 1e-3f * scale) {
+				std::cerr << "the folded network disagrees with the network, which is used unfolded instead" << std::endl;
+				inference.reset();
+			}
+		}
+		if (meta["int8"] == "1" && !device.is_cpu()) {
+			std::cerr << "int8 is for CPU inference, ignored on " << device << std::endl;
+		} else if (meta["int8"] == "1" && inference) {
+			torch::NoGradGuard no_grad;
+			int n = std::max(std::stoi(meta["calibration"]), 1);
+			rng engine(n);
+			torch::Tensor calibration = sample(n, engine), test = sample(n, engine);
+			auto [v_ref, p_ref] = network->forward(test);
+			inference->quantize(calibration);
+			auto [v_int8, p_int8] = inference->forward(test);
+			std::cerr << "int8 policy top-1 agreement " << az::top1_agreement(p_ref, p_int8) << ", value max difference "
+			          << (v_ref - v_int8).abs().max().item<float>() << " on " << n << " positions" << std::endl;
+		}
+
+		if (meta["search"] == "puct") {
+			int threads = std::max(std::stoi(meta["search_threads"]), 1);
+			int batch = std::min(std::stoi(meta["batch"]), threads); // no more positions are ever queued at once
+			queue.reset(new batch_queue([this](const float* inputs, int n, float* policies, float* values) {
+				forward(inputs, n, policies, values);
+			}, batch, std::stod(meta["wait"]) / 1000));
+			int bits = std::stoi(meta["cache_bits"]);
+			if (bits > 0) cache.reset(new eval_cache(bits));
+			tree.reset(new puct(*queue, threads, std::stof(meta["c_puct"]), 1, cache.get()));
+			clock.reset(new time_manager(std::stod(meta["timeout"])));
+			N = std::stoi(meta["N"]);
+		}
+		// the position is encoded on the CPU, into page-locked memory when it is copied over to a GPU
+		input = torch::zeros({1, 7, 9, 9}, torch::TensorOptions().dtype(torch::kFloat32).pinned_memory(device.is_cuda()));
 	}
 
 	int get_move(MovingStates &moving_states) {
-		auto data = moving_states.getTensor();
-		data = data.to(torch::kCUDA);
-		auto [v_out, p_out] = network->forward(data);
-		p_out = torch::softmax(p_out, 1);
+		if (tree) {
+			const std::deque<board>& s = moving_states.states;
+			clock->start(s[2]);
+			int move = tree->search(s[0], s[1], s[2], clock->bounded() ? N : std::max(N, 1), *clock);
+			stats = tree->statistics();
+			stats.seconds = clock->elapsed();
+			return move;
+		}
+
+		torch::NoGradGuard no_grad;
+		moving_states.getTensor(input);
+		auto [v_out, p_out] = run(device.is_cpu() ? input : input.to(device, /*non_blocking=*/true));
+		// softmax keeps the order of the logits, so the most likely legal move is read from them directly
+		torch::Tensor policy = p_out.to(torch::kCPU).contiguous();
+		const float* logits = policy.data_ptr<float>();
 		
 		float max_prob = -std::numeric_limits<float>::max();
 		int best_move = -1;
+		const board& curr_b = moving_states.states[2];
+		const bitboard& legal = curr_b.legal_moves(curr_b.info().who_take_turns);
 		for (int i = 0; i < 81; ++i) {
-			board curr_b = moving_states.states[2];
-			if (curr_b.place(i) == board::legal) {
-				float prob = p_out[0][i].template item<float>();
+			if (legal.test(i)) {
+				float prob = logits[i];
 				if (prob > max_prob) {
 					max_prob = prob;
 					best_move = i;
@@ -371,7 +767,63 @@ public:
 		return best_move;
 	}
 
+	/**
+	 * the telemetry of the last search, if there is one
+	 */
+	bool searched() const { return tree != nullptr; }
+	const search_stats& statistics() const { return stats; }
+
+	/**
+	 * evaluate n encoded positions at once for the batch queue, the policies are logits
+	 */
+	void forward(const float* inputs, int n, float* policies, float* values) {
+		torch::NoGradGuard no_grad;
+		torch::Tensor batch = torch::from_blob(const_cast<float*>(inputs), {n, 7, 9, 9});
+		auto [v_out, p_out] = run(device.is_cpu() ? batch : batch.to(device));
+		torch::Tensor policy = p_out.to(torch::kCPU).contiguous(), value = v_out.to(torch::kCPU).contiguous();
+		std::copy(policy.data_ptr<float>(), policy.data_ptr<float>() + n * 81, policies);
+		std::copy(value.data_ptr<float>(), value.data_ptr<float>() + n, values);
+	}
 
+private:
+	std::tuple<torch::Tensor, torch::Tensor> run(const torch::Tensor& x) {
+		return inference ? inference->forward(x) : network->forward(x);
+	}
+
+	/**
+	 * a position c of a random game, reached from a through b
+	 */
+	static void play(rng& engine, board& a, board& b, board& c) {
+		for (int plies = engine.below(60); plies > 0; plies--) {
+			bitboard legal = c.legal_moves(c.info().who_take_turns);
+			if (!legal) break;
+			a = b;
+			b = c;
+			c.place(legal.nth(engine.below(legal.count())));
+		}
+	}
+
+	/**
+	 * n positions of random games, encoded as inputs of the network
+	 */
+	static torch::Tensor sample(int n, rng& engine) {
+		torch::Tensor inputs = torch::zeros({n, 7, 9, 9});
+		for (int i = 0; i < n; i++) {
+			board a, b, c;
+			play(engine, a, b, c);
+			MovingStates::encode(inputs.data_ptr<float>() + i * batch_queue::input_size, a, b, c);
+		}
+		return inputs;
+	}
 
+	torch::Device device;
+	std::unique_ptr<az::InferenceNetwork> inference; // the network for inference, unless fold=0
+	torch::Tensor input; // the encoded position, allocated once
+	std::unique_ptr<batch_queue> queue;
+	std::unique_ptr<eval_cache> cache;
+	std::unique_ptr<puct> tree; // only with search=puct
+	std::unique_ptr<time_manager> clock;
+	int N = 0;
+	search_stats stats;
 };
 
@@ -0,0 +1,104 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * batch_queue.h: Define the queue that batches the network evaluations of the search threads
+ *
+ * a search thread submits the encoded input of a position and sleeps until its policy and value are back;
+ * the evaluation thread runs the network once on up to (batch) positions, as soon as that many are queued
+ * or the oldest of them has waited (wait) seconds, so that the search threads share their forward passes
+ */
+
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+class batch_queue {
+public:
+	/**
+	 * the network evaluates n inputs at once, and writes n policies (logits) and n values
+	 */
+	typedef std::function<void(const float* inputs, int n, float* policies, float* values)> network;
+	enum size { input_size = 7 * 9 * 9, policy_size = 9 * 9 };
+
+	batch_queue(network forward, int batch = 8, double wait = 0.001) : forward(forward), batch(std::max(batch, 1)),
+		wait(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(wait))),
+		inputs(this->batch * input_size), policies(this->batch * policy_size), values(this->batch), quit(false) {
+		thread = std::thread(&batch_queue::run, this);
+	}
+	~batch_queue() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		ready.notify_one();
+		thread.join();
+	}
+	batch_queue(const batch_queue&) = delete;
+	batch_queue& operator =(const batch_queue&) = delete;
+
+	/**
+	 * evaluate one position, blocks until its batch is done
+	 */
+	void evaluate(const float* input, float* policy, float& value) {
+		request r = { input, policy, &value, clock::now(), false };
+		std::unique_lock<std::mutex> lock(mutex);
+		queue.push_back(&r);
+		if (queue.size() == 1 || queue.size() >= size_t(batch)) ready.notify_one();
+		done.wait(lock, [&]() { return r.done; });
+	}
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	struct request {
+		const float* input;
+		float* policy;
+		float* value;
+		clock::time_point since;
+		bool done;
+	};
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			ready.wait(lock, [&]() { return quit || queue.size(); });
+			if (quit) return;
+			ready.wait_until(lock, queue.front()->since + wait, [&]() { return quit || queue.size() >= size_t(batch); });
+			if (quit) return;
+
+			std::vector<request*> taken(queue.begin(), queue.begin() + std::min<size_t>(batch, queue.size()));
+			queue.erase(queue.begin(), queue.begin() + taken.size());
+			lock.unlock();
+			int n = taken.size();
+			for (int i = 0; i < n; i++) {
+				std::copy(taken[i]->input, taken[i]->input + input_size, inputs.data() + i * input_size);
+			}
+			forward(inputs.data(), n, policies.data(), values.data());
+			for (int i = 0; i < n; i++) {
+				std::copy(policies.data() + i * policy_size, policies.data() + (i + 1) * policy_size, taken[i]->policy);
+				*taken[i]->value = values[i];
+			}
+			lock.lock();
+			for (request* r : taken) r->done = true;
+			done.notify_all();
+		}
+	}
+
+	network forward;
+	int batch;
+	clock::duration wait;
+	std::vector<float> inputs;
+	std::vector<float> policies;
+	std::vector<float> values;
+	std::deque<request*> queue;
+	std::mutex mutex;
+	std::condition_variable ready; // wakes the evaluation thread
+	std::condition_variable done; // wakes the search threads
+	bool quit;
+	std::thread thread;
+};
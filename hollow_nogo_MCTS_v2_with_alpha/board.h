@@ -9,12 +9,12 @@
 
 #pragma once
 #include <array>
-#include <list>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
 #include <utility>
 #include <cmath>
+#include "bitboard.h"
 
 /**
  * definition for the 9x9 board
@@ -55,8 +55,13 @@ public:
 	typedef int reward;
 
 public:
-	board() : stone(initial()), attr({piece_type::black}) {}
-	board(const grid& b, const data& d) : stone(b), attr(d) {}
+	board() : stone(), chain(), liberty(), legal_move{vacancy(), vacancy()}, attr({piece_type::black}), key(0) {}
+	board(const grid& b, const data& d) : stone(), chain(), liberty(), legal_move(), attr(d), key(0) {
+		for (int x = 0; x < size_x; x++)
+			for (int y = 0; y < size_y; y++)
+				set_cell(point(x, y).i, b[x][y]);
+		rebuild_chains();
+	}
 	board(const board& b) = default;
 	board& operator =(const board& b) = default;
 
@@ -76,21 +81,74 @@ public:
 		}
 	};
 
-	operator grid&() { return stone; }
-	operator const grid&() const { return stone; }
-	column& operator [](unsigned x) { return stone[x]; }
-	const column& operator [](unsigned x) const { return stone[x]; }
-	cell& operator ()(unsigned i) { point p(i); return stone[p.x][p.y]; }
-	const cell& operator ()(unsigned i) const { point p(i); return stone[p.x][p.y]; }
-	cell& operator ()(const std::string& move) { point p(move); return stone[p.x][p.y]; }
-	const cell& operator ()(const std::string& move) const { point p(move); return stone[p.x][p.y]; }
+	/**
+	 * the stones are stored as one bitboard per color, cells are accessed through proxies
+	 * so that the usual b[x][y] and b(i) syntax still works for reading and writing
+	 */
+	class cell_ref {
+	public:
+		cell_ref(board& b, int i) : b(b), i(i) {}
+		operator cell() const { return b.get_cell(i); }
+		cell_ref& operator =(cell v) { b.set_cell(i, v); b.rebuild_chains(); return *this; }
+		cell_ref& operator =(const cell_ref& r) { return operator =(cell(r)); }
+	private:
+		board& b;
+		int i;
+	};
+	class column_ref {
+	public:
+		column_ref(board& b, unsigned x) : b(b), x(x) {}
+		cell_ref operator [](unsigned y) { return cell_ref(b, point(x, y).i); }
+		cell operator [](unsigned y) const { return b.get_cell(point(x, y).i); }
+	private:
+		board& b;
+		unsigned x;
+	};
+	class const_column_ref {
+	public:
+		const_column_ref(const board& b, unsigned x) : b(b), x(x) {}
+		cell operator [](unsigned y) const { return b.get_cell(point(x, y).i); }
+	private:
+		const board& b;
+		unsigned x;
+	};
+
+	operator grid() const {
+		grid g;
+		for (int x = 0; x < size_x; x++)
+			for (int y = 0; y < size_y; y++)
+				g[x][y] = get_cell(point(x, y).i);
+		return g;
+	}
+	column_ref operator [](unsigned x) { return column_ref(*this, x); }
+	const_column_ref operator [](unsigned x) const { return const_column_ref(*this, x); }
+	cell_ref operator ()(unsigned i) { return cell_ref(*this, i); }
+	cell operator ()(unsigned i) const { return get_cell(i); }
+	cell_ref operator ()(const std::string& move) { return cell_ref(*this, point(move).i); }
+	cell operator ()(const std::string& move) const { return get_cell(point(move).i); }
+
+	/**
+	 * the set of stones of given color (piece_type::black or piece_type::white)
+	 */
+	const bitboard& stones(unsigned who) const { return stone[who - 1]; }
+	bitboard empties() const { return ~(stone[0] | stone[1] | hollows()) & points(); }
+
+	/**
+	 * the set of points at which given color may legally place a stone, regardless of whose turn it is
+	 */
+	const bitboard& legal_moves(unsigned who) const { return legal_move[who - 1]; }
 
 	data info() const { return attr; }
-	data info(data dat) { data old = attr; attr = dat; return old; }
+	data info(data dat) { data old = attr; attr = dat; key ^= turn_key(old.who_take_turns) ^ turn_key(dat.who_take_turns); return old; }
+
+	/**
+	 * the zobrist hash of the position including the side to move, updated incrementally by place()
+	 */
+	uint64_t hash() const { return key; }
 
 public:
-	bool operator ==(const board& b) const { return stone == b.stone; }
-	bool operator < (const board& b) const { return stone <  b.stone; }
+	bool operator ==(const board& b) const { return stone[0] == b.stone[0] && stone[1] == b.stone[1]; }
+	bool operator < (const board& b) const { return stone[0] != b.stone[0] ? stone[0] < b.stone[0] : stone[1] < b.stone[1]; }
 	bool operator !=(const board& b) const { return !(*this == b); }
 	bool operator > (const board& b) const { return b < *this; }
 	bool operator <=(const board& b) const { return !(b < *this); }
@@ -118,17 +176,35 @@ public:
 		if (x == -1 && y == -1) return nogo_move_result::illegal_pass;
 		point p_min(0, 0), p_max(size_x - 1, size_y - 1);
 		if (x < p_min.x || x > p_max.x || y < p_min.y || y > p_max.y) return nogo_move_result::illegal_out_of_range;
-		if (board::initial()[x][y] == piece_type::hollow)             return nogo_move_result::illegal_out_of_range;
-		board test = *this;
-		if (test[x][y] != piece_type::empty) return nogo_move_result::illegal_not_empty;
-		test[x][y] = who; // try put a piece first
-		if (test.check_liberty(x, y, who) == 0) return nogo_move_result::illegal_suicide;
+		int i = point(x, y).i;
+		if (hollows().test(i))                                        return nogo_move_result::illegal_out_of_range;
+		if (!empties().test(i)) return nogo_move_result::illegal_not_empty;
 		unsigned opp = 3u - who;
-		if (x > p_min.x && test.check_liberty(x - 1, y, opp) == 0) return nogo_move_result::illegal_take;
-		if (x < p_max.x && test.check_liberty(x + 1, y, opp) == 0) return nogo_move_result::illegal_take;
-		if (y > p_min.y && test.check_liberty(x, y - 1, opp) == 0) return nogo_move_result::illegal_take;
-		if (y < p_max.y && test.check_liberty(x, y + 1, opp) == 0) return nogo_move_result::illegal_take;
-		stone[x][y] = who; // is legal move!
+		contact near = contact_of(i);
+		if (!legal_move[who - 1].test(i)) { // the mask is exact, this only finds out the reason
+			reward result = evaluate(near, who);
+			if (result != nogo_move_result::legal) return result;
+		}
+		// is legal move!
+		stone[who - 1].set(i);
+		int merged = -1, merged_liberty = near.empty;
+		for (int k = 0; k < near.n; k++) {
+			int r = near.root[k];
+			if (stone[who - 1].test(r)) {
+				merged_liberty += liberty[r] - near.touch[k];
+				if (merged == -1 || liberty[r] > liberty[merged]) merged = r; // keep the larger block as root
+			} else {
+				liberty[r] -= near.touch[k];
+			}
+		}
+		if (merged == -1) merged = i;
+		chain[i] = merged;
+		for (int k = 0; k < near.n; k++)
+			if (stone[who - 1].test(near.root[k])) chain[near.root[k]] = merged;
+		chain[merged] = merged;
+		liberty[merged] = merged_liberty;
+		update_legal_moves(i, near);
+		key ^= zobrist()[who - 1][i] ^ turn_key(who) ^ turn_key(opp);
 		attr.who_take_turns = static_cast<piece_type>(opp);
 		return nogo_move_result::legal;
 	}
@@ -138,61 +214,25 @@ public:
 
 	/**
 	 * calculate the liberty of the block of piece at [x][y]
+	 * the liberty is counted once per adjacent (stone, empty) pair, so it is 0 iff the block has no liberty
 	 * return >= 0 if [x][y] is placed by who; otherwise return -1
 	 */
 	int check_liberty(int x, int y, unsigned who) const {
-		grid test = stone;
-		if (test[x][y] != who) return -1;
-
-		int liberty = 0;
-		std::list<point> check;
-		for (check.emplace_back(x, y); check.size(); check.pop_front()) {
-			int x = check.front().x, y = check.front().y;
-			test[x][y] = piece_type::unknown; // prevent recalculate
-
-			point p_min(0, 0), p_max(size_x - 1, size_y - 1);
-
-			cell near_l = x > p_min.x ? test[x - 1][y] : -1u; // left
-			if (near_l == piece_type::empty) liberty++;
-			else if (near_l == who) check.emplace_back(x - 1, y);
-
-			cell near_r = x < p_max.x ? test[x + 1][y] : -1u; // right
-			if (near_r == piece_type::empty) liberty++;
-			else if (near_r == who) check.emplace_back(x + 1, y);
-
-			cell near_d = y > p_min.y ? test[x][y - 1] : -1u; // down
-			if (near_d == piece_type::empty) liberty++;
-			else if (near_d == who) check.emplace_back(x, y - 1);
-
-			cell near_u = y < p_max.y ? test[x][y + 1] : -1u; // up
-			if (near_u == piece_type::empty) liberty++;
-			else if (near_u == who) check.emplace_back(x, y + 1);
-		}
-		return liberty;
+		int i = point(x, y).i;
+		if (get_cell(i) != who) return -1;
+		return liberty[find(i)];
 	}
 
 	void transpose() {
-		for (int x = 0; x < size_x; x++) {
-			for (int y = x + 1; y < size_y; y++) {
-				std::swap(stone[x][y], stone[y][x]);
-			}
-		}
+		permute([](int x, int y) { return point(y, x); });
 	}
 
 	void reflect_horizontal() {
-		for (int y = 0; y < size_y; y++) {
-			for (int x = 0; x < size_x / 2; x++) {
-				std::swap(stone[x][y], stone[size_x - 1 - x][y]);
-			}
-		}
+		permute([](int x, int y) { return point(size_x - 1 - x, y); });
 	}
 
 	void reflect_vertical() {
-		for (int x = 0; x < size_x; x++) {
-			for (int y = 0; y < size_y / 2; y++) {
-				std::swap(stone[x][y], stone[x][size_y - 1 - y]);
-			}
-		}
+		permute([](int x, int y) { return point(x, size_y - 1 - y); });
 	}
 
 	/**
@@ -212,6 +252,14 @@ public:
 	void rotate_left() { transpose(); reflect_horizontal(); } // counterclockwise
 	void reverse() { reflect_horizontal(); reflect_vertical(); }
 
+public:
+	/**
+	 * the set of points 4-adjacent to any point of the given set
+	 */
+	static bitboard neighbors(const bitboard& b) {
+		return ((b << size_y) | (b >> size_y) | ((b & ~edge_up()) << 1) | ((b & ~edge_down()) >> 1)) & points();
+	}
+
 public:
 	friend std::ostream& operator <<(std::ostream& out, const board& b) {
 		std::ios ff(nullptr);
@@ -273,15 +321,208 @@ public:
 	}
 
 protected:
-	static const grid& initial() { static grid stone; return stone; }
+	cell get_cell(int i) const {
+		if (stone[0].test(i)) return piece_type::black;
+		if (stone[1].test(i)) return piece_type::white;
+		if (hollows().test(i)) return piece_type::hollow;
+		return piece_type::empty;
+	}
+	void set_cell(int i, cell v) {
+		if (hollows().test(i)) return; // the hollow is fixed
+		stone[0].reset(i);
+		stone[1].reset(i);
+		if (v == piece_type::black || v == piece_type::white) stone[v - 1].set(i);
+	}
+
+	/**
+	 * the distinct blocks next to an empty point, how many times each of them touches it,
+	 * and how many empty points are next to it
+	 */
+	struct contact {
+		int n, empty;
+		int root[4], touch[4];
+	};
+	contact contact_of(int i) const {
+		contact c;
+		c.n = c.empty = 0;
+		for (int near : adjacency()[i]) {
+			if (near == -1) break;
+			if (!stone[0].test(near) && !stone[1].test(near)) {
+				c.empty += hollows().test(near) ? 0 : 1;
+				continue;
+			}
+			int r = find(near), k = 0;
+			while (k < c.n && c.root[k] != r) k++;
+			if (k == c.n) c.root[c.n] = r, c.touch[c.n++] = 0;
+			c.touch[k]++;
+		}
+		return c;
+	}
+
+	/**
+	 * check whether who can put a stone at an empty point with given contact
+	 * return nogo_move_result::legal, nogo_move_result::illegal_suicide, or nogo_move_result::illegal_take
+	 */
+	reward evaluate(const contact& c, unsigned who) const {
+		int own_liberty = c.empty;
+		bool take = false;
+		for (int k = 0; k < c.n; k++) {
+			if (stone[who - 1].test(c.root[k])) own_liberty += liberty[c.root[k]] - c.touch[k];
+			else take |= liberty[c.root[k]] == c.touch[k];
+		}
+		if (own_liberty == 0) return nogo_move_result::illegal_suicide;
+		if (take)             return nogo_move_result::illegal_take;
+		return nogo_move_result::legal;
+	}
+
+	/**
+	 * in NoGo a point never becomes legal again once it is illegal, so after a stone is put at i,
+	 * only the points whose surroundings changed have to be checked for becoming illegal:
+	 * the empty neighbors of i that have no empty neighbor left (which may now be suicide),
+	 * and the last liberty of any block next to i that is now in atari
+	 */
+	void update_legal_moves(int i, const contact& near) {
+		legal_move[0].reset(i);
+		legal_move[1].reset(i);
+		bitboard free = empties(), check = neighbors(bitboard::bit(i)) & free & ~neighbors(free);
+		int roots[5] = { find(i) }, n = 1;
+		for (int k = 0; k < near.n; k++)
+			if (find(near.root[k]) != roots[0]) roots[n++] = near.root[k];
+		for (int k = 0; k < n; k++) {
+			int r = roots[k];
+			if (liberty[r] > 4) continue; // an atari block touches its last liberty at most 4 times
+			const bitboard& own = stone[0].test(r) ? stone[0] : stone[1];
+			bitboard last = neighbors(block(bitboard::bit(r), own)) & free;
+			if (last.count() == 1) check |= last;
+		}
+		for (bitboard rest = check & (legal_move[0] | legal_move[1]); rest.any(); ) {
+			int p = rest.pop_first();
+			contact c = contact_of(p);
+			for (unsigned who = piece_type::black; who <= piece_type::white; who++)
+				if (legal_move[who - 1].test(p) && evaluate(c, who) != nogo_move_result::legal)
+					legal_move[who - 1].reset(p);
+		}
+	}
+
+	/**
+	 * the block of stones in the given set connected to the seed
+	 */
+	static bitboard block(bitboard seed, const bitboard& own) {
+		for (bitboard grow = (seed | neighbors(seed)) & own; grow != seed; grow = (seed | neighbors(seed)) & own)
+			seed = grow;
+		return seed;
+	}
+
+	/**
+	 * blocks are kept as a union-find forest over the stones, since stones are never removed in NoGo,
+	 * blocks only ever merge; the root of each block holds its liberty
+	 */
+	int find(int i) const {
+		while (chain[i] != i) i = chain[i];
+		return i;
+	}
+	int find(int i) {
+		while (chain[i] != i) i = chain[i] = chain[chain[i]];
+		return i;
+	}
+	void rebuild_chains() { // also rebuilds the legal moves and the hash
+		bitboard free = empties();
+		key = turn_key(attr.who_take_turns);
+		for (unsigned who = piece_type::black; who <= piece_type::white; who++)
+			for (bitboard rest = stone[who - 1]; rest.any(); )
+				key ^= zobrist()[who - 1][rest.pop_first()];
+		for (int i = 0; i < size_x * size_y; i++) {
+			chain[i] = i;
+			liberty[i] = 0;
+			for (int near : adjacency()[i])
+				if (near != -1 && free.test(near)) liberty[i]++;
+		}
+		for (bitboard& own : stone) {
+			for (bitboard rest = own; rest.any(); ) {
+				int i = rest.pop_first();
+				for (int near : adjacency()[i]) {
+					if (near == -1 || !own.test(near)) continue;
+					int a = find(i), b = find(near);
+					if (a != b) chain[b] = a, liberty[a] += liberty[b];
+				}
+			}
+		}
+		for (unsigned who = piece_type::black; who <= piece_type::white; who++) {
+			legal_move[who - 1] = bitboard();
+			for (bitboard rest = free; rest.any(); ) {
+				int p = rest.pop_first();
+				if (evaluate(contact_of(p), who) == nogo_move_result::legal) legal_move[who - 1].set(p);
+			}
+		}
+	}
+
+	template<typename mapping>
+	void permute(mapping map) {
+		for (bitboard& bb : stone) {
+			bitboard moved;
+			for (bitboard rest = bb; rest.any(); ) {
+				point p(rest.pop_first());
+				moved.set(map(p.x, p.y).i);
+			}
+			bb = moved;
+		}
+		rebuild_chains();
+	}
+
+	static const bitboard& hollows() { static bitboard mask; return mask; }
+	static const bitboard& points() { static bitboard mask; return mask; }
+	static const bitboard& edge_up() { static bitboard mask; return mask; }
+	static const bitboard& edge_down() { static bitboard mask; return mask; }
+	static bitboard vacancy() { return points() & ~hollows(); }
+	typedef std::array<int8_t, 4> adjacent; // up to 4 neighbors of a point, padded with -1
+	static const std::array<adjacent, size_x * size_y>& adjacency() { static std::array<adjacent, size_x * size_y> near; return near; }
+	typedef std::array<uint64_t, size_x * size_y> keys;
+	static const std::array<keys, 2>& zobrist() { static std::array<keys, 2> key; return key; }
+	static const uint64_t& zobrist_turn() { static uint64_t key; return key; }
+	static uint64_t turn_key(unsigned who) { return who == piece_type::white ? zobrist_turn() : 0; }
 	static __attribute__((constructor)) void init_initial_scheme() {
-		grid& stone = const_cast<grid&>(initial());
 		point hollow((size_x - hollow_x) / 2, (size_y - hollow_y) / 2);
 		for (int x = hollow.x; x < hollow.x + hollow_x; x++)
 			for (int y = hollow.y; y < hollow.y + hollow_y; y++)
-				stone[x][y] = piece_type::hollow;
+				const_cast<bitboard&>(hollows()).set(point(x, y).i);
+		for (int x = 0; x < size_x; x++) {
+			for (int y = 0; y < size_y; y++)
+				const_cast<bitboard&>(points()).set(point(x, y).i);
+			const_cast<bitboard&>(edge_up()).set(point(x, size_y - 1).i);
+			const_cast<bitboard&>(edge_down()).set(point(x, 0).i);
+		}
+		auto& near = const_cast<std::array<adjacent, size_x * size_y>&>(adjacency());
+		for (int x = 0; x < size_x; x++) {
+			for (int y = 0; y < size_y; y++) {
+				adjacent& adj = near[point(x, y).i];
+				adj.fill(-1);
+				int n = 0;
+				if (x > 0) adj[n++] = point(x - 1, y).i;
+				if (x < size_x - 1) adj[n++] = point(x + 1, y).i;
+				if (y > 0) adj[n++] = point(x, y - 1).i;
+				if (y < size_y - 1) adj[n++] = point(x, y + 1).i;
+			}
+		}
+		uint64_t seed = 0x9e3779b97f4a7c15ull; // fixed, so the hashes are the same in every run
+		auto splitmix = [&seed]() {
+			uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			return z ^ (z >> 31);
+		};
+		for (keys& k : const_cast<std::array<keys, 2>&>(zobrist()))
+			for (uint64_t& v : k) v = splitmix();
+		const_cast<uint64_t&>(zobrist_turn()) = splitmix();
 	}
 private:
-	grid stone;
+	// 248 bytes in all: four 16-byte bitboards, 81 bytes each of chain and liberty, the attributes and the hash;
+	// every tree node holds a copy, so the chain and liberty arrays take up most of a node
+	bitboard stone[2];
+	std::array<uint8_t, size_x * size_y> chain; // union-find parent of each stone
+	std::array<uint8_t, size_x * size_y> liberty; // liberty of the block, valid at the root only
+	bitboard legal_move[2];
 	data attr;
+	uint64_t key; // zobrist hash
 };
+
+static_assert(sizeof(board) <= 256, "a board is copied into every tree node");
@@ -0,0 +1,139 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * eval_cache.h: Define the cache of the network evaluations
+ *
+ * the network sees a position together with the two positions before it, so an entry is keyed by a hash
+ * of these three boards; the board is symmetric under its 8 rotations and reflections, the key is taken
+ * from the symmetry with the least hash and the policy is kept in that orientation, so that all 8 images
+ * of a position share one entry; the table has a fixed number of entries, a new entry replaces the old
+ * one in its slot, and the slots are guarded by a set of locks so that all search threads may use it
+ */
+
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "board.h"
+#include "rng.h"
+
+class eval_cache {
+public:
+	enum size { policy_size = 9 * 9, symmetries = 8 };
+
+	/**
+	 * the key of a position and the symmetry that maps it onto its canonical orientation
+	 */
+	struct key {
+		uint64_t hash;
+		int symmetry;
+	};
+
+	eval_cache(int bits = 16) : mask((size_t(1) << bits) - 1), table(mask + 1), hits(0), lookups(0) {}
+
+	/**
+	 * the key of position c, reached from a through b
+	 */
+	static key canonical(const board& a, const board& b, const board& c) {
+		const tables& t = get_tables();
+		uint64_t h[symmetries] = {};
+		const board* s[] = { &c, &b, &a };
+		for (int n = 0; n < 3; n++) {
+			for (unsigned who = board::black; who <= board::white; who++) {
+				const uint64_t* z = t.zobrist[n][who - 1];
+				for (bitboard stones = s[n]->stones(who); stones; ) {
+					int i = stones.pop_first();
+					for (int k = 0; k < symmetries; k++) h[k] ^= z[t.map[k][i]];
+				}
+			}
+		}
+		key best = { h[0], 0 };
+		for (int k = 1; k < symmetries; k++) {
+			if (h[k] < best.hash) best = { h[k], k };
+		}
+		if (c.info().who_take_turns == board::white) best.hash ^= t.white;
+		best.hash |= 1; // 0 marks an empty entry, so the low bit is not used to index the table
+		return best;
+	}
+
+	/**
+	 * the cached policy logits and value of the position of key k, false if it is not cached
+	 */
+	bool find(const key& k, float* policy, float& value) {
+		lookups.fetch_add(1, std::memory_order_relaxed);
+		size_t slot = (k.hash >> 1) & mask;
+		entry& e = table[slot];
+		std::lock_guard<std::mutex> lock(locks[slot % stripes]);
+		if (e.hash != k.hash) return false;
+		const int* map = get_tables().map[k.symmetry];
+		for (int i = 0; i < policy_size; i++) policy[i] = e.policy[map[i]];
+		value = e.value;
+		hits.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	void store(const key& k, const float* policy, float value) {
+		size_t slot = (k.hash >> 1) & mask;
+		entry& e = table[slot];
+		std::lock_guard<std::mutex> lock(locks[slot % stripes]);
+		const int* map = get_tables().map[k.symmetry];
+		for (int i = 0; i < policy_size; i++) e.policy[map[i]] = policy[i];
+		e.value = value;
+		e.hash = k.hash;
+	}
+
+	/**
+	 * lookups and hits since the cache was made
+	 */
+	long hit_count() const { return hits.load(); }
+	long lookup_count() const { return lookups.load(); }
+
+private:
+	struct entry {
+		uint64_t hash = 0;
+		float value = 0;
+		float policy[policy_size];
+	};
+
+	struct tables {
+		int map[symmetries][policy_size]; // map[k][i] is the image of point i under symmetry k
+		uint64_t zobrist[3][2][policy_size]; // of the stones of each color on each of the three boards
+		uint64_t white; // white to move
+	};
+
+	/**
+	 * the symmetries are taken from the board itself, k = 4 * f + r reflects the board if f and then rotates it r times;
+	 * the hollow maps onto itself, its points are never moves and are left in place
+	 */
+	static const tables& get_tables() {
+		static const tables t = []() {
+			tables t;
+			for (int k = 0; k < symmetries; k++) {
+				for (int i = 0; i < policy_size; i++) {
+					board b;
+					b(i) = board::black;
+					if (k / 4) b.reflect_horizontal();
+					b.rotate(k % 4);
+					t.map[k][i] = b.stones(board::black) ? b.stones(board::black).first() : i;
+				}
+			}
+			rng engine(0x5eed);
+			for (auto& plane : t.zobrist) {
+				for (auto& color : plane) {
+					for (uint64_t& z : color) z = engine();
+				}
+			}
+			t.white = engine();
+			return t;
+		}();
+		return t;
+	}
+
+	static const size_t stripes = 64;
+	size_t mask;
+	std::vector<entry> table;
+	std::mutex locks[stripes];
+	std::atomic<long> hits;
+	std::atomic<long> lookups;
+};
@@ -0,0 +1,233 @@
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <cmath>
+#include <torch/torch.h>
+#include <ATen/core/dispatch/Dispatcher.h>
+#include "network.h"
+
+#pragma once
+
+namespace az {
+
+/**
+* \brief Run an operator of the quantized library (quantized::<name>) and return its first output.
+*/
+inline c10::IValue call_quantized(const char* name, const char* overload, std::vector<c10::IValue> stack)
+{
+    c10::Dispatcher::singleton().findSchemaOrThrow(name, overload).callBoxed(&stack);
+    return stack[0];
+}
+
+/**
+* \brief Scale and zero point of an 8-bit unsigned tensor that covers [low, high] (and 0).
+*/
+struct QuantParams {
+    double scale = 1;
+    int64_t zero_point = 0;
+
+    QuantParams() = default;
+    QuantParams(float low, float high)
+    {
+        low = std::min(low, 0.0f);
+        high = std::max(high, 0.0f);
+        scale = std::max(double(high - low) / 255, 1e-8);
+        zero_point = std::min<int64_t>(std::max<int64_t>(std::llround(-low / scale), 0), 255);
+    }
+};
+
+// Convolution with its batch normalization folded into the weights and the bias.
+struct FoldedConv {
+
+    FoldedConv() = default;
+    FoldedConv(const torch::nn::Conv2d &conv, const torch::nn::BatchNorm2d &batch_norm, bool relu) : relu(relu)
+    {
+        // w * g / sqrt(var + eps), (b - mean) * g / sqrt(var + eps) + beta
+        auto scale = batch_norm->weight / torch::sqrt(batch_norm->running_var + batch_norm->options.eps());
+        weight = (conv->weight * scale.view({-1, 1, 1, 1})).detach().contiguous();
+        auto shift = conv->bias.defined() ? conv->bias - batch_norm->running_mean : -batch_norm->running_mean;
+        bias = (shift * scale + batch_norm->bias).detach().contiguous();
+        padding = weight.size(2) / 2; // all convolutions of the network keep the board size
+    }
+
+    torch::Tensor forward(const torch::Tensor &x) const
+    {
+        auto y = torch::conv2d(x, weight, bias, {1, 1}, {padding, padding});
+        return relu ? y.relu_() : y;
+    }
+
+    /**
+    * \brief Switch to INT8: per output channel weights, and a uint8 output of the given range.
+    */
+    void quantize(const QuantParams &output)
+    {
+        auto w = weight.to(torch::kCPU);
+        auto scales = (w.abs().amax({1, 2, 3}).to(torch::kDouble) / 127).clamp_min(1e-8);
+        auto zeros = torch::zeros({w.size(0)}, torch::kLong);
+        auto qw = torch::quantize_per_channel(w, scales, zeros, 0, torch::kQInt8);
+        packed = call_quantized("quantized::conv2d_prepack", "", {qw, c10::optional<torch::Tensor>(bias.to(torch::kCPU)),
+            c10::List<int64_t>({1, 1}), c10::List<int64_t>({padding, padding}), c10::List<int64_t>({1, 1}), int64_t(1)});
+        out = output;
+    }
+
+    torch::Tensor forward_int8(const torch::Tensor &qx) const
+    {
+        return call_quantized(relu ? "quantized::conv2d_relu" : "quantized::conv2d", "new",
+            {qx, packed, out.scale, out.zero_point}).toTensor();
+    }
+
+    torch::Tensor weight, bias;
+    int64_t padding = 0;
+    bool relu = false;
+    c10::IValue packed;
+    QuantParams out;
+};
+
+// Linear layer, with INT8 weights and dynamically quantized inputs once quantized.
+struct DenseLayer {
+
+    DenseLayer() = default;
+    DenseLayer(const torch::nn::Linear &fc) :
+        weight(fc->weight.detach().contiguous()),
+        bias(fc->bias.detach().contiguous())
+    {
+    }
+
+    torch::Tensor forward(const torch::Tensor &x) const
+    {
+        if (packed.isNone())
+            return torch::linear(x, weight, bias);
+        return call_quantized("quantized::linear_dynamic", "", {x.contiguous(), packed, false}).toTensor();
+    }
+
+    void quantize()
+    {
+        auto w = weight.to(torch::kCPU);
+        double scale = std::max(w.abs().max().item<double>() / 127, 1e-8);
+        auto qw = torch::quantize_per_tensor(w, scale, 0, torch::kQInt8);
+        packed = call_quantized("quantized::linear_prepack", "", {qw, c10::optional<torch::Tensor>(bias.to(torch::kCPU))});
+    }
+
+    torch::Tensor weight, bias;
+    c10::IValue packed;
+};
+
+/**
+* \brief Inference-only copy of an AlphaZeroNetwork, with every batch normalization folded into its convolution.
+* After quantize(), the input block and the residual blocks run as INT8 convolutions on CPU, with the
+* activation ranges taken from a calibration batch, and the linear layers of the heads use INT8 weights;
+* the small 1x1 convolutions of the heads stay in float.
+*/
+struct InferenceNetwork {
+
+    InferenceNetwork(const AlphaZeroNetwork &net)
+    {
+        torch::NoGradGuard no_grad;
+        input_block = FoldedConv(net->input_block->conv, net->input_block->batch_norm, true);
+        for (auto &block : net->res_blocks) {
+            res_blocks.push_back({FoldedConv(block->conv_1, block->batch_norm_1, true),
+                FoldedConv(block->conv_2, block->batch_norm_2, false), QuantParams()});
+        }
+        p_conv = FoldedConv(net->p_head->conv, net->p_head->batch_norm, true);
+        p_fc = DenseLayer(net->p_head->fc);
+        v_conv = FoldedConv(net->v_head->conv, net->v_head->batch_norm, true);
+        v_fc_1 = DenseLayer(net->v_head->fc_1);
+        v_fc_2 = DenseLayer(net->v_head->fc_2);
+    }
+
+    /**
+    * \brief Quantize to INT8 (CPU only), with the activation ranges observed on a batch of inputs.
+    */
+    void quantize(const torch::Tensor &calibration)
+    {
+        torch::NoGradGuard no_grad;
+        std::vector<std::pair<float, float>> ranges;
+        trunk(calibration, &ranges);
+        auto range = ranges.begin();
+        auto next = [&range]() { auto r = *range++; return QuantParams(r.first, r.second); };
+        input = next();
+        input_block.quantize(next());
+        for (auto &block : res_blocks) {
+            block.conv_1.quantize(next());
+            block.conv_2.quantize(next());
+            block.sum = next();
+        }
+        p_fc.quantize();
+        v_fc_1.quantize();
+        v_fc_2.quantize();
+        quantized = true;
+    }
+
+    std::tuple<torch::Tensor, torch::Tensor> forward(torch::Tensor x)
+    {
+        torch::NoGradGuard no_grad;
+        x = quantized ? trunk_int8(x) : trunk(x, nullptr);
+
+        auto policy = p_fc.forward(p_conv.forward(x).flatten(1));
+        auto value = v_conv.forward(x).flatten(1);
+        value = v_fc_1.forward(value).relu_();
+        value = v_fc_2.forward(value).tanh_();
+
+        return {value, policy};
+    }
+
+private:
+    struct Block {
+        FoldedConv conv_1;
+        FoldedConv conv_2;
+        QuantParams sum; // of the output of the block
+    };
+
+    /**
+    * \brief The input block and the residual blocks in float, recording the range of every activation if asked.
+    */
+    torch::Tensor trunk(torch::Tensor x, std::vector<std::pair<float, float>> *ranges) const
+    {
+        auto observe = [ranges](const torch::Tensor &t) {
+            if (ranges) ranges->push_back({t.min().item<float>(), t.max().item<float>()});
+        };
+        observe(x);
+        x = input_block.forward(x);
+        observe(x);
+        for (auto &block : res_blocks) {
+            auto y = block.conv_1.forward(x);
+            observe(y);
+            y = block.conv_2.forward(y);
+            observe(y);
+            x = y.add_(x).relu_();
+            observe(x);
+        }
+        return x;
+    }
+
+    torch::Tensor trunk_int8(const torch::Tensor &x) const
+    {
+        auto q = torch::quantize_per_tensor(x.to(torch::kCPU).contiguous(), input.scale, input.zero_point, torch::kQUInt8);
+        q = input_block.forward_int8(q);
+        for (auto &block : res_blocks) {
+            auto y = block.conv_2.forward_int8(block.conv_1.forward_int8(q));
+            q = call_quantized("quantized::add_relu", "", {y, q, block.sum.scale, block.sum.zero_point}).toTensor();
+        }
+        return q.dequantize();
+    }
+
+    FoldedConv input_block;
+    std::vector<Block> res_blocks;
+    FoldedConv p_conv;
+    DenseLayer p_fc;
+    FoldedConv v_conv;
+    DenseLayer v_fc_1;
+    DenseLayer v_fc_2;
+    QuantParams input;
+    bool quantized = false;
+};
+
+/**
+* \brief Fraction of the positions whose most likely move is the same under two policies (logits or probabilities).
+*/
+inline double top1_agreement(const torch::Tensor &p, const torch::Tensor &q)
+{
+    return p.argmax(1).eq(q.argmax(1)).to(torch::kFloat).mean().item<double>();
+}
+
+} // namespace
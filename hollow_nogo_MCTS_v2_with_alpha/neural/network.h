@@ -5,6 +5,8 @@
 
 namespace az {
 
+struct InferenceNetwork;
+
 /**
 * \brief Options for neural network. Defaults are for chess.
 * \param planes Number of input planes or depth in other words.
@@ -40,6 +42,7 @@ struct InputConvImpl : torch::nn::Module {
     }
 
 private:
+    friend struct InferenceNetwork;
     torch::nn::Conv2d conv = nullptr;
     torch::nn::BatchNorm2d batch_norm = nullptr;
 };
@@ -62,19 +65,19 @@ struct ResBlockImpl : torch::nn::Module {
 
     torch::Tensor forward(torch::Tensor x) 
     {
-        auto identity = x.clone();
-
-        x = batch_norm_1(conv_1(x));
-        x = torch::relu(x);
-        x = batch_norm_2(conv_2(x));
+        // x is not written to, the skip connection needs no copy of it
+        auto y = batch_norm_1(conv_1(x));
+        y = torch::relu(y);
+        y = batch_norm_2(conv_2(y));
 
-        x += identity;
-        x = torch::relu(x);
+        y += x;
+        y = torch::relu(y);
 
-        return x;
+        return y;
     }
 
 private:
+    friend struct InferenceNetwork;
     torch::nn::Conv2d conv_1 = nullptr;
     torch::nn::Conv2d conv_2 = nullptr;
     torch::nn::BatchNorm2d batch_norm_1 = nullptr;
@@ -105,6 +108,7 @@ struct PolicyHeadImpl : torch::nn::Module {
     }
 
 private:
+    friend struct InferenceNetwork;
     torch::nn::Conv2d conv = nullptr;
     torch::nn::BatchNorm2d batch_norm = nullptr;
     torch::nn::Linear fc = nullptr;
@@ -136,6 +140,7 @@ struct ValueHeadImpl : torch::nn::Module {
         return x;
     }
 private:
+    friend struct InferenceNetwork;
     torch::nn::Conv2d conv = nullptr;
     torch::nn::BatchNorm2d batch_norm = nullptr;
     torch::nn::Linear fc_1 = nullptr;
@@ -174,6 +179,7 @@ struct AlphaZeroNetworkImpl : torch::nn::Module {
     }
 
 private:
+    friend struct InferenceNetwork;
     InputConv input_block;
     std::vector<ResBlock> res_blocks;
     PolicyHead p_head;
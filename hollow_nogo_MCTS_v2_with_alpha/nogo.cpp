@@ -28,6 +28,7 @@ int main(int argc, const char* argv[]) {
 	size_t total = 1000, block = 0, limit = 0;
 	int split = 30;
 	std::string black_args, white_args;
+	std::string alpha_args;
 	std::string load, save;
 	std::string name = "TCG-HollowNoGo-Demo", version = "2021"; // for GTP shell
 	bool summary = false, shell = false;
@@ -45,6 +46,8 @@ int main(int argc, const char* argv[]) {
 			black_args = para.substr(para.find("=") + 1);
 		} else if (para.find("--white=") == 0) {
 			white_args = para.substr(para.find("=") + 1);
+		} else if (para.find("--alpha=") == 0) {
+			alpha_args = para.substr(para.find("=") + 1);
 		} else if (para.find("--load=") == 0) {
 			load = para.substr(para.find("=") + 1);
 		} else if (para.find("--save=") == 0) {
@@ -72,16 +75,20 @@ int main(int argc, const char* argv[]) {
 	player black("name=black " + black_args + " role=black");
 	player white("name=white " + white_args + " role=white");
 
-	if (!shell) { // launch standard local games
+	if (!shell) { // launch standard local games, played as in the GTP shell: alphago opens, MCTS finishes
+		MovingStates moving_states;
+		AlphaGo alphago(alpha_args);
 		while (!stat.is_finished()) {
 			black.open_episode("~:" + white.name());
 			white.open_episode(black.name() + ":~");
 
 			stat.open_episode(black.name() + ":" + white.name());
 			episode& game = stat.back();
-			while (true) {
+			moving_states.clean();
+			for (int steps = 1; ; steps++) {
 				agent& who = game.take_turns(black, white);
-				action move = who.take_action(game.state(), 0);
+				moving_states.add_state(game.state());
+				action move = who.take_action(game.state(), steps > split ? -1 : alphago.get_move(moving_states));
 				if (game.apply_action(move) != true) break;
 				if (who.check_for_win(game.state())) break;
 			}
@@ -92,20 +99,34 @@ int main(int argc, const char* argv[]) {
 			white.close_episode(win.name());
 		}
 	} else { // launch GTP shell
+		agent* searched = &black; // the player of the last genmove
+		// whether args[first...] are all numbers, as the time commands expect
+		auto numbers = [](const std::vector<std::string>& args, size_t first) {
+			for (size_t i = first; i < args.size(); i++) {
+				std::istringstream in(args[i]);
+				double value;
+				if (!(in >> value) || !in.eof()) return false;
+			}
+			return true;
+		};
+		bool alpha_searched = false; // whether that move was played by alphago
 		MovingStates moving_states;
-		AlphaGo alphago;
+		AlphaGo alphago(alpha_args);
 		int steps = 0;
 		//std::fstream debug("record.txt", std::ios::app);
 
 		for (std::string command; std::getline(std::cin, command); ) {
 			if (command.back() == '\r') command.pop_back();
 			if (command.empty()) continue;
+			black.stop_pondering(); // a new command ends the background search after our last move
+			white.stop_pondering();
 
 			std::vector<std::string> args;
 			std::istringstream iss(command);
 			for (std::string s; getline(iss, s, ' '); args.push_back(s));
 
 			std::string reply;
+			std::string status = "="; // "?" for a command that fails
 			if (args[0] == "play" || args[0] == "genmove") { // play a move, or generate a move and play
 				if (!stat.is_episode_ongoing()) { // should open an episode
 					steps = 0;
@@ -152,6 +173,8 @@ int main(int argc, const char* argv[]) {
 						break;
 					}
 				} else if (args[0] == "genmove") { // generate a move and play
+					searched = &who;
+					alpha_searched = steps + 1 <= split && alphago.searched();
 					//debug << "genmove" << std::endl;
 					moving_states.add_state(game.state());
 					steps++;
@@ -173,6 +196,7 @@ int main(int argc, const char* argv[]) {
 					
 					if (game.apply_action(move) == true) {
 						reply = move.position();
+						if (steps + 2 > split) who.ponder(game.state()); // our next move is searched by MCTS
 					} else { // I have no legal move to play
 						reply = "resign";
 					}
@@ -202,6 +226,30 @@ int main(int argc, const char* argv[]) {
 				}
 				if (size > board::size_x || size > board::size_y) break;
 
+			} else if (args[0] == "time_settings") { // set the main time and byo-yomi of both players
+				if (args.size() != 4 || !numbers(args, 1)) {
+					status = "?";
+					reply = "syntax error";
+				} else {
+					std::string settings = args[1] + " " + args[2] + " " + args[3];
+					black.notify("time_settings=" + settings);
+					white.notify("time_settings=" + settings);
+				}
+
+			} else if (args[0] == "time_left") { // update the remaining time of a player
+				if (args.size() != 4 || args[1].empty() || std::string("bBwW").find(args[1][0]) == std::string::npos || !numbers(args, 2)) {
+					status = "?";
+					reply = "syntax error";
+				} else {
+					player& who = std::tolower(args[1][0]) == 'b' ? black : white;
+					who.notify("time_left=" + args[2] + " " + args[3]);
+				}
+
+			} else if (args[0] == "search_stats") { // report the statistics of the last search of a player
+				agent& who = args.size() < 2 ? *searched : std::tolower(args[1][0]) == 'w' ? white : black;
+				bool alpha = args.size() < 2 ? alpha_searched : alpha_searched && &who == searched;
+				reply = "\n" + (alpha ? alphago.statistics().text() : who.property("search_stats"));
+
 			} else if (args[0] == "name") { // report the name of the program
 				reply = name;
 			} else if (args[0] == "version") { // report the version number of the program
@@ -209,13 +257,13 @@ int main(int argc, const char* argv[]) {
 			} else if (args[0] == "protocol_version") { // report GTP protocol version
 				reply = "2";
 			} else if (args[0] == "list_commands") { // print supported commands
-				reply = "play\n" "genmove\n" "clear_board\n" "showboard\n" "boardsize\n"
+				reply = "play\n" "genmove\n" "clear_board\n" "showboard\n" "boardsize\n" "time_settings\n" "time_left\n" "search_stats\n"
 				        "name\n" "version\n" "protocol_version\n" "list_commands\n" "quit\n";
 			} else {
 				reply = "unknown command";
 			}
 
-			std::cout << "= " << reply << std::endl << std::endl;
+			std::cout << status << " " << reply << std::endl << std::endl;
 		}
 	}
 
@@ -0,0 +1,246 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * puct.h: Define the AlphaZero-style search guided by the policy and value network
+ *
+ * the search threads descend the tree by PUCT, the value of a move plus c_puct times its prior scaled by
+ * sqrt(visits of the position) / (1 + visits of the move), and put a virtual loss on every move on the way
+ * so that the threads spread over different lines; a new position is evaluated through the batch queue,
+ * its legal moves get the softmax of the policy logits as priors, and its value (for the side to move)
+ * is backed up in place of a playout; a position without legal moves is lost and needs no evaluation;
+ * with an evaluation cache, a position whose evaluation is cached skips the queue altogether
+ */
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <algorithm>
+#include "board.h"
+#include "arena.h"
+#include "thread_pool.h"
+#include "time_manager.h"
+#include "batch_queue.h"
+#include "eval_cache.h"
+#include "search_stats.h"
+#include "stateTorch.h"
+
+class puct {
+public:
+	puct(batch_queue& queue, int threads = 1, float c_puct = 1.5, float virtual_loss = 1, eval_cache* cache = nullptr) :
+		queue(queue), cache(cache), threads(std::max(threads, 1)), pools(std::max(threads, 1)), c_puct(c_puct), virtual_loss(virtual_loss),
+		root(nullptr), history{nullptr, nullptr}, visited(0) {}
+
+	/**
+	 * search position c, reached from a through b, for N visits (0 for no limit) or until timer expires;
+	 * return the most visited move, or -1 if there is no legal move
+	 */
+	int search(const board& a, const board& b, const board& c, int N, const time_manager& timer) {
+		for (arena& pool : pools) pool.reset();
+		long hits = cache ? cache->hit_count() : 0, lookups = cache ? cache->lookup_count() : 0;
+		stats.reset();
+		history[0] = &a;
+		history[1] = &b;
+		root = pools[0].make<node>(c);
+		root->status.store(expanding);
+		expand(root, pools[0], std::vector<node*>(1, root));
+		if (root->child_cnt == 0) return -1;
+
+		std::atomic<long> started(0);
+		std::vector<search_stats> records(pools.size());
+		threads.run([&](int id) {
+			std::vector<node*> path;
+			std::vector<int> slot;
+			while (!(timer.bounded() && timer.expired()) && (N == 0 || started.fetch_add(1) < N)) {
+				if (!iteration(pools[id], path, slot, records[id])) {
+					if (N) started--; // ran into a position still being evaluated, try again
+					std::this_thread::yield();
+				}
+			}
+		});
+		visited = root->total.load();
+		for (size_t id = 0; id < pools.size(); id++) {
+			records[id].arena_used = pools[id].used();
+			records[id].arena_reserved = pools[id].reserved();
+			stats += records[id];
+		}
+		if (cache) {
+			stats.cache_hits = cache->hit_count() - hits;
+			stats.cache_lookups = cache->lookup_count() - lookups;
+		}
+
+		int best = 0;
+		for (int k = 1; k < root->child_cnt; k++) {
+			if (root->visits[k].load() > root->visits[best].load()) best = k;
+		}
+		return root->move[best];
+	}
+
+	/**
+	 * visits of the root of the last search
+	 */
+	long visits() const { return visited; }
+
+	/**
+	 * the telemetry of the last search, without its wall time
+	 */
+	const search_stats& statistics() const { return stats; }
+
+private:
+	enum { fresh, expanding, expanded };
+
+	struct node {
+		node(const board& state) : state(state), status(fresh), total(0), child_cnt(0),
+			move(nullptr), prior(nullptr), visits(nullptr), value(nullptr), child(nullptr) {}
+		board state;
+		std::atomic<int> status;
+		std::atomic<int> total;
+		int child_cnt;
+		int* move;
+		float* prior;
+		std::atomic<int>* visits;
+		std::atomic<float>* value; // the sum of the values of each move, for the side to move here
+		std::atomic<node*>* child; // made by the first thread that selects the move
+	};
+
+	/**
+	 * one descent from the root, false if it ended at a position that another thread is evaluating
+	 */
+	bool iteration(arena& pool, std::vector<node*>& path, std::vector<int>& slot, search_stats& record) {
+		record.begin();
+		path.assign(1, root);
+		slot.clear();
+		node* n = root;
+		while (n->status.load(std::memory_order_acquire) == expanded && n->child_cnt > 0) {
+			int k = select(n);
+			n->total.fetch_add(1, std::memory_order_relaxed);
+			n->visits[k].fetch_add(1, std::memory_order_relaxed);
+			add(n->value[k], -virtual_loss);
+			node* c = n->child[k].load(std::memory_order_acquire);
+			if (c == nullptr) {
+				board after = n->state;
+				after.place(n->move[k]);
+				node* made = pool.make<node>(after);
+				c = n->child[k].compare_exchange_strong(c, made) ? made : c;
+			}
+			path.push_back(c);
+			slot.push_back(k);
+			n = c;
+		}
+		record.lap(search_stats::select);
+
+		float v = -1; // for the side to move at n, which has lost if it has no legal move
+		bool added = n->status.load(std::memory_order_acquire) != expanded;
+		if (added) {
+			int expected = fresh;
+			if (!n->status.compare_exchange_strong(expected, expanding)) {
+				revert(path, slot);
+				return false;
+			}
+			v = expand(n, pool, path);
+		}
+		record.lap(search_stats::expand);
+		backup(path, slot, v);
+		record.lap(search_stats::backpropagate);
+		record.iteration(slot.size(), added);
+		return true;
+	}
+
+	int select(node* n) {
+		float scale = c_puct * std::sqrt(float(n->total.load(std::memory_order_relaxed)) + 1);
+		float max_score = -std::numeric_limits<float>::max();
+		int best = 0;
+		for (int k = 0; k < n->child_cnt; k++) {
+			int visits = n->visits[k].load(std::memory_order_relaxed);
+			float q = visits ? n->value[k].load(std::memory_order_relaxed) / visits : 0;
+			float score = q + scale * n->prior[k] / (1 + visits);
+			if (score > max_score) {
+				max_score = score;
+				best = k;
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * evaluate the position at the end of path and make its moves, return its value for the side to move
+	 */
+	float expand(node* n, arena& pool, const std::vector<node*>& path) {
+		bitboard legal = n->state.legal_moves(n->state.info().who_take_turns);
+		int count = legal.count();
+		float v = -1;
+		if (count) {
+			float input[batch_queue::input_size], logits[batch_queue::policy_size];
+			eval_cache::key key = {};
+			if (cache) key = eval_cache::canonical(before(path, 2), before(path, 1), n->state);
+			if (!cache || !cache->find(key, logits, v)) {
+				MovingStates::encode(input, before(path, 2), before(path, 1), n->state);
+				queue.evaluate(input, logits, v);
+				if (cache) cache->store(key, logits, v);
+			}
+
+			n->move = pool.make_array<int>(count);
+			n->prior = pool.make_array<float>(count);
+			n->visits = pool.make_array<std::atomic<int>>(count);
+			n->value = pool.make_array<std::atomic<float>>(count);
+			n->child = pool.make_array<std::atomic<node*>>(count);
+			float high = -std::numeric_limits<float>::max(), sum = 0;
+			for (int k = 0; k < count; k++) {
+				n->move[k] = legal.pop_first();
+				high = std::max(high, logits[n->move[k]]);
+			}
+			for (int k = 0; k < count; k++) {
+				n->prior[k] = std::exp(logits[n->move[k]] - high);
+				sum += n->prior[k];
+			}
+			for (int k = 0; k < count; k++) {
+				n->prior[k] /= sum;
+			}
+			n->child_cnt = count;
+		}
+		n->status.store(expanded, std::memory_order_release);
+		return v;
+	}
+
+	/**
+	 * the board d plies before the end of path, taken from the history above the root
+	 */
+	const board& before(const std::vector<node*>& path, int d) const {
+		int i = int(path.size()) - 1 - d;
+		return i >= 0 ? path[i]->state : *history[2 + i];
+	}
+
+	/**
+	 * replace the virtual losses on path by value v of its last position, each move is valued for its mover
+	 */
+	void backup(const std::vector<node*>& path, const std::vector<int>& slot, float v) {
+		for (int i = int(slot.size()) - 1; i >= 0; i--) {
+			v = -v;
+			add(path[i]->value[slot[i]], v + virtual_loss);
+		}
+	}
+	void revert(const std::vector<node*>& path, const std::vector<int>& slot) {
+		for (int i = 0; i < int(slot.size()); i++) {
+			path[i]->total.fetch_sub(1, std::memory_order_relaxed);
+			path[i]->visits[slot[i]].fetch_sub(1, std::memory_order_relaxed);
+			add(path[i]->value[slot[i]], virtual_loss);
+		}
+	}
+
+	static void add(std::atomic<float>& sum, float v) {
+		float old = sum.load(std::memory_order_relaxed);
+		while (!sum.compare_exchange_weak(old, old + v, std::memory_order_relaxed));
+	}
+
+	batch_queue& queue;
+	eval_cache* cache; // optional
+	thread_pool threads;
+	std::vector<arena> pools; // one per thread
+	float c_puct;
+	float virtual_loss;
+	node* root;
+	const board* history[2]; // the two positions before the root
+	long visited;
+	search_stats stats;
+};
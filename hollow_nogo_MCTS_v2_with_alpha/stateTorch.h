@@ -15,62 +15,62 @@ public:
 	
 	torch::Tensor getTensor() {
 		auto tmp_data = torch::zeros({1, 7, 9, 9}); // N, C, H, W
-		board a = states[0];
-		board b = states[1];
-		board c = states[2];
-		a.rotate_left();
-		b.rotate_left();
-		c.rotate_left();
+		getTensor(tmp_data);
+		return tmp_data;
+	}
 
-		// current board
-		for (int i = 0; i < 9; ++i) {
-			for (int j = 0; j < 9; ++j) {
-				if (c[i][j] == board::black) {
-					tmp_data.index_put_({0, 0, i, j}, 1);
-				} else if (c[i][j] == board::white) {
-					tmp_data.index_put_({0, 3, i, j}, -1);
-				}
-			}
-		}
+	// encode into a preallocated contiguous float tensor of {1, 7, 9, 9} instead, written through its data pointer
+	void getTensor(torch::Tensor& tmp_data) {
+		encode(tmp_data.data_ptr<float>(), states[0], states[1], states[2]);
+	}
 
-		for (int i = 0; i < 9; ++i) {
-			for (int j = 0; j < 9; ++j) {
-				if (b[i][j] == board::black) {
-					tmp_data.index_put_({0, 1, i, j}, 1);
-				} else if (b[i][j] == board::white) {
-					tmp_data.index_put_({0, 4, i, j}, -1);
-				}
-			}
+	// the 7 x 9 x 9 input planes of position c, reached from a through b;
+	// the planes hold the boards rotated counterclockwise, so the stone at (x, y) goes to row 8 - y and column x
+	static void encode(float* data, const board& a, const board& b, const board& c) {
+		std::fill(data, data + 7 * 81, 0.0f);
+		const board* s[] = { &c, &b, &a }; // the current board, then the last two
+		for (int t = 0; t < 3; ++t) {
+			encode(data + t * 81, s[t]->stones(board::black), 1);
+			encode(data + (3 + t) * 81, s[t]->stones(board::white), -1);
 		}
-
-		for (int i = 0; i < 9; ++i) {
-			for (int j = 0; j < 9; ++j) {
-				if (a[i][j] == board::black) {
-					tmp_data.index_put_({0, 2, i, j}, 1);
-				} else if (a[i][j] == board::white) {
-					tmp_data.index_put_({0, 5, i, j}, -1);
-				}
-			}
+		float turn = c.info().who_take_turns == board::black ? 1 : -1;
+		std::fill(data + 6 * 81, data + 7 * 81, turn);
+	}
+	
+	static void encode(float* plane, bitboard stones, float value) {
+		while (stones) {
+			board::point p(stones.pop_first());
+			plane[(board::size_y - 1 - p.y) * board::size_x + p.x] = value;
 		}
+	}
 
-		if (c.info().who_take_turns == board::black) {
+	// the encoding as the network was trained with it, the boards rotated counterclockwise and read cell by cell;
+	// slow, it is kept as the reference that encode() is checked against
+	static torch::Tensor rotatedTensor(board a, board b, board c) {
+		auto tmp_data = torch::zeros({1, 7, 9, 9});
+		a.rotate_left();
+		b.rotate_left();
+		c.rotate_left();
+		const board* s[] = { &c, &b, &a };
+		for (int t = 0; t < 3; ++t) {
 			for (int i = 0; i < 9; ++i) {
 				for (int j = 0; j < 9; ++j) {
-					tmp_data.index_put_({0, 6, i, j}, 1);
+					if ((*s[t])[i][j] == board::black) {
+						tmp_data.index_put_({0, t, i, j}, 1);
+					} else if ((*s[t])[i][j] == board::white) {
+						tmp_data.index_put_({0, 3 + t, i, j}, -1);
+					}
 				}
 			}
-		} else {
-			for (int i = 0; i < 9; ++i) {
-				for (int j = 0; j < 9; ++j) {
-					tmp_data.index_put_({0, 6, i, j}, -1);
-				}
+		}
+		for (int i = 0; i < 9; ++i) {
+			for (int j = 0; j < 9; ++j) {
+				tmp_data.index_put_({0, 6, i, j}, c.info().who_take_turns == board::black ? 1 : -1);
 			}
 		}
-
 		return tmp_data;
 	}
 	
-	
 	void add_state(board b) {
 		states.pop_front();
 		states.push_back(b);
@@ -0,0 +1,115 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * transposition.h: Define the lock-free transposition table used by the search
+ *
+ * the table maps the zobrist hash of a position to the search node of that position,
+ * so that different move orders reaching the same position share one node (the tree becomes a DAG);
+ * a lookup probes a few entries after the home slot, and when they are all taken by other positions
+ * the new position is left unshared, which is counted; the table is sized with reserve() for the nodes
+ * it is to hold, at four times their number, which keeps such failures rare (reserve() rehashes the entries,
+ * so it must not run concurrently with find or insert)
+ */
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+template<typename value>
+class transposition {
+public:
+	transposition(int bits = 16) : mask((size_t(1) << bits) - 1), table(new entry[mask + 1]), failed(0) { clear(); }
+	transposition(transposition&& t) : mask(t.mask), table(std::move(t.table)), failed(t.failed.load()) {}
+	transposition& operator =(transposition&& t) {
+		mask = t.mask;
+		table = std::move(t.table);
+		failed.store(t.failed.load());
+		return *this;
+	}
+
+	/**
+	 * the value stored for the key, or nullptr if there is none
+	 */
+	value* find(uint64_t key) const {
+		for (size_t n = 0, i = key & mask; n < probe && key; n++, i = (i + 1) & mask) {
+			uint64_t k = table[i].key.load(std::memory_order_acquire);
+			if (k == key) return table[i].data.load(std::memory_order_acquire);
+			if (k == 0) break;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * store the value for the key unless another value is already there,
+	 * return the value that the table holds for the key afterwards
+	 * (v itself if it could not be stored, since the entries around the home slot are taken)
+	 */
+	value* insert(uint64_t key, value* v) {
+		for (size_t n = 0, i = key & mask; n < probe && key; n++, i = (i + 1) & mask) {
+			uint64_t k = table[i].key.load(std::memory_order_acquire);
+			if (k == 0 && table[i].key.compare_exchange_strong(k, key, std::memory_order_acq_rel)) {
+				table[i].data.store(v, std::memory_order_release);
+				return v;
+			}
+			if (k == key) { // another thread may be still publishing its value, then keep ours unshared
+				value* d = table[i].data.load(std::memory_order_acquire);
+				return d ? d : v;
+			}
+		}
+		if (key) failed.fetch_add(1, std::memory_order_relaxed);
+		return v;
+	}
+
+	/**
+	 * grow the table to at least four times n entries, keeping what it holds
+	 */
+	void reserve(size_t n) {
+		if (4 * n <= mask + 1) return;
+		size_t size = mask + 1;
+		while (size < 4 * n) size *= 2;
+		std::unique_ptr<entry[]> old(std::move(table));
+		size_t old_size = mask + 1;
+		mask = size - 1;
+		table.reset(new entry[size]);
+		for (size_t i = 0; i < size; i++) {
+			table[i].key.store(0, std::memory_order_relaxed);
+			table[i].data.store(nullptr, std::memory_order_relaxed);
+		}
+		for (size_t i = 0; i < old_size; i++) {
+			uint64_t key = old[i].key.load(std::memory_order_relaxed);
+			value* v = old[i].data.load(std::memory_order_relaxed);
+			if (key && v) insert(key, v);
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	/**
+	 * remove all entries, must not run concurrently with find or insert
+	 */
+	void clear() {
+		for (size_t i = 0; i <= mask; i++) {
+			table[i].key.store(0, std::memory_order_relaxed);
+			table[i].data.store(nullptr, std::memory_order_relaxed);
+		}
+		failed.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	size_t size() const { return mask + 1; }
+
+	/**
+	 * positions left unshared since the last clear, since the entries around their home slot were taken
+	 */
+	long failures() const { return failed.load(std::memory_order_relaxed); }
+
+private:
+	struct entry {
+		std::atomic<uint64_t> key; // 0 marks an empty entry
+		std::atomic<value*> data;
+	};
+	static const size_t probe = 8;
+	size_t mask;
+	std::unique_ptr<entry[]> table;
+	std::atomic<long> failed;
+};
@@ -14,12 +14,23 @@
 #include <map>
 #include <type_traits>
 #include <algorithm>
+#include <thread>
+#include <unordered_map>
 #include "board.h"
 #include "action.h"
+#include "rng.h"
+#include "playout.h"
+#include "arena.h"
+#include "transposition.h"
+#include "time_manager.h"
+#include "solver.h"
+#include "search_stats.h"
+#include "tree_limit.h"
+#include "thread_pool.h"
 #include <fstream>
 
 #include <bits/stdc++.h>
-#include <omp.h>
+#include <atomic>
 
 class agent {
 public:
@@ -36,6 +47,8 @@ public:
 	virtual void close_episode(const std::string& flag = "") {}
 	virtual action take_action(const board& b) { return action(); }
 	virtual bool check_for_win(const board& b) { return false; }
+	virtual void ponder(const board& b) {}
+	virtual void stop_pondering() {}
 
 public:
 	virtual std::string property(const std::string& key) const { return meta.at(key); }
@@ -68,7 +81,7 @@ public:
 	virtual ~random_agent() {}
 
 protected:
-	std::default_random_engine engine;
+	rng engine;
 };
 
 /**
@@ -77,8 +90,8 @@ protected:
  */
 class player : public random_agent {
 public:
-	player(const std::string& args = "") : random_agent("name=random role=unknown N=0 c=0 " + args),
-		space(board::size_x * board::size_y), who(board::empty) {
+	player(const std::string& args = "") : random_agent("name=random role=unknown N=0 verbose=0 timeout=0 total_time=0 c=0 parallel=root share=0 threads=0 pin= ponder=0 solve=20 solve_budget=500000 stats_log= max_nodes=0 max_mem=0 " + args),
+		space(board::size_x * board::size_y), who(board::empty), timer(meta["timeout"], meta["total_time"]), ponder_timer(meta["ponder"]), limit(meta["max_nodes"], meta["max_mem"]) {
 		if (name().find_first_of("[]():; ") != std::string::npos)
 			throw std::invalid_argument("invalid name: " + name());
 		if (role() == "black") who = board::black;
@@ -88,48 +101,192 @@ public:
 		for (size_t i = 0; i < space.size(); i++)
 			space[i] = action::place(i, who);
 	}
+	virtual ~player() { stop_pondering(); }
+
+	virtual void notify(const std::string& msg) {
+		// time_settings=<main time> <byo-yomi time> <byo-yomi stones> and time_left=<time> <stones> from GTP
+		std::string key = msg.substr(0, msg.find('='));
+		std::istringstream in(msg.substr(msg.find('=') + 1));
+		if (key == "time_settings") {
+			double main_time = 0, byo_yomi_time = 0;
+			int byo_yomi_stones = 0;
+			in >> main_time >> byo_yomi_time >> byo_yomi_stones;
+			timer.set_time_settings(main_time, byo_yomi_time, byo_yomi_stones);
+		} else if (key == "time_left") {
+			double time = 0;
+			int stones = 0;
+			in >> time >> stones;
+			timer.set_time_left(time, stones);
+		} else {
+			random_agent::notify(msg);
+		}
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		// the tree is only kept within a game
+		timer.reset();
+		endgame.clear();
+		for(worker& w : workers){
+			w.pool.reset();
+			w.table.clear();
+			w.tree = nullptr;
+		}
+	}
+
+	/**
+	 * keep searching in the background from state, the position after our move, until the opponent replies;
+	 * ponder=<seconds> bounds such a search (0 for no pondering), and the next search takes over
+	 * the subtree of the move the opponent actually plays
+	 */
+	virtual void ponder(const board& state) {
+		stop_pondering();
+		if(!ponder_timer.bounded() || state.legal_moves(state.info().who_take_turns).count() == 0){
+			return;
+		}
+		bool verbose = int(meta["verbose"]);
+		ponder_timer.start(state);
+		if(threads == nullptr){
+			start_workers();
+		}
+		ponder_thread = std::thread([this, state, verbose](){
+			search(state, 0, ponder_timer);
+			playout pondered;
+			for(const worker& w : workers){
+				pondered += w.simulator;
+			}
+			if(verbose){
+				std::cerr << "pondered playouts = " << pondered.count() << ", seconds = " << ponder_timer.elapsed() << std::endl;
+			}
+		});
+	}
+
+	virtual void stop_pondering() {
+		if(ponder_thread.joinable()){
+			ponder_timer.interrupt();
+			ponder_thread.join();
+		}
+	}
+
+	/**
+	 * complete the statistics of the last search, which played move (-1 for none), and append them
+	 * to stats_log=<path> as one JSON object per line if a path is given
+	 */
+	void record(int move){
+		stats.seconds = timer.elapsed();
+		stats.arena_used = 0;
+		stats.arena_reserved = 0;
+		for(const worker& w : workers){
+			stats.arena_used += w.pool.used();
+			stats.arena_reserved += w.pool.reserved() + w.spare.reserved();
+		}
+		std::string path = meta["stats_log"];
+		if(path.size()){
+			std::ofstream log(path, std::ios::app);
+			log << stats.json(name(), move != -1 ? std::string(board::point(move)) : "resign") << std::endl;
+		}
+	}
+
+	virtual std::string property(const std::string& key) const {
+		// search_stats is the telemetry of the last search
+		if(key == "search_stats"){
+			return stats.text();
+		}
+		return random_agent::property(key);
+	}
+
+	/**
+	 * a winning move found by the exact endgame solver once the side to move has at most solve=<moves> legal moves,
+	 * or -1 if the position is lost or not solved within solve_budget=<positions> and the time of the move,
+	 * then MCTS takes over
+	 */
+	int solve_endgame(const board& state){
+		if(state.legal_moves(state.info().who_take_turns).count() > int(meta["solve"])){
+			return -1;
+		}
+		int move = -1;
+		solver::result result = endgame.solve(state, meta["solve_budget"], timer, move);
+		if(int(meta["verbose"])){
+			const char* name[] = { "lost", "unknown", "won" };
+			std::cerr << "solver = " << name[result + 1] << ", positions = " << endgame.nodes() << std::endl;
+		}
+		return result == solver::won ? move : -1;
+	}
 
 	virtual action take_action(const board& state) {
 		int N = meta["N"];
-		float c = meta["c"];
-		if(N){
-			// root parallelizing
-			int thread_num = omp_get_num_procs();
-			omp_set_num_threads(thread_num);
-			std::vector<int> majority_vote(thread_num, 0);
+		if(N || timer.bounded()){
+			// root parallelizing (parallel=root) or tree parallelizing (parallel=tree)
+			if(threads == nullptr){
+				start_workers();
+			}
 
 			//std::fstream debug("record.txt", std::ios::app);
 
-			#pragma omp parallel
-			{
-				int id = omp_get_thread_num();
-				node* root = new node(state);
-				int vote_move = root->MCTS(N, engine, c);
-				delete_tree(root);
-				majority_vote[id] = vote_move;
+			timer.start(state);
+			stats.reset();
+			int solved = solve_endgame(state);
+			if(solved != -1){
+				timer.stop();
+				record(solved);
+				return action::place(solved, state.info().who_take_turns);
+			}
+			simulator.reset();
+			root_stats merged{};
+			std::vector<root_share> shares(threads->size(), root_share(&merged));
+			node* shared = search(state, N, timer, &shares);
+			for(const worker& w : workers){
+				simulator += w.simulator;
+				stats += w.stats;
+				stats.unshared += w.table.failures();
+			}
+			timer.stop();
+			if(int(meta["verbose"])){
+				std::cerr << "playouts = " << simulator.count() << ", playouts/sec = " << simulator.rate() << ", seconds = " << timer.elapsed() << std::endl;
 			}
 
-			std::vector<int> vote_result(81, 0);
-			for(auto &v : majority_vote){
-				if(v != -1){
-					//debug << v << " ";
-					vote_result[v]++;
+			int result = -1;
+			if(shared != nullptr){
+				result = shared->select_action();
+			}else{
+				// select the most visited move over the merged statistics of all threads, as select_action() does
+				// for one tree (and as decided() assumes); ties go to the highest win rate
+				// a move proven to win in some tree is played at once, and one proven to lose only when all moves lose
+				bool losing[board::size_x * board::size_y] = {};
+				int win = -1;
+				for(const worker& w : workers){
+					int m = w.tree != nullptr ? w.tree->proven_moves(losing) : -1;
+					win = m != -1 ? m : win;
 				}
+				float max_score = -std::numeric_limits<float>::max();
+				int max_visits = 0;
+				bool best_losing = false;
+				for(int m = 0; m < board::size_x * board::size_y; ++m){
+					int total = merged.total[m];
+					if(total == 0){
+						continue;
+					}
+					float tmp = (float)merged.win[m] / total;
+					bool better = total > max_visits || (total == max_visits && tmp > max_score);
+					if(result == -1 || (best_losing && !losing[m]) || (losing[m] == best_losing && better)){
+						max_score = tmp;
+						max_visits = total;
+						result = m;
+						best_losing = losing[m];
+					}
+				}
+				result = win != -1 ? win : result;
 			}
+			record(result);
 
-			//debug << std::endl;
 			//debug.close();
 
-			std::vector<int>::iterator iter = max_element(vote_result.begin(), vote_result.end());
-			if((*iter) == 0){
+			if(result == -1){
 				return action();
 			}
-
-			int result = iter - vote_result.begin();
 			return action::place(result, state.info().who_take_turns);
 		}
 
-		std::shuffle(space.begin(), space.end(), engine);
+		engine.shuffle(space.begin(), space.end());
 		for (const action::place& move : space) {
 			board after = state;
 			if (move.apply(after) == board::legal)
@@ -138,219 +295,581 @@ public:
 		return action();
 	}
 
+	/**
+	 * root statistics of root parallelizing, summed over the threads and indexed by move;
+	 * every thread publishes what its own tree added since its last exchange, and when sharing
+	 * during the search (share=<iterations>) also takes in what the other threads have published
+	 */
+	struct root_stats {
+		std::atomic<int> total[board::size_x * board::size_y];
+		std::atomic<int> win[board::size_x * board::size_y];
+		std::atomic<bool> solved; // some tree has proven its root, the others may stop too
+	};
+	struct root_share {
+		root_share(root_stats* merged) : merged(merged), published_total(), published_win(), foreign_total(), foreign_win() {}
+		root_stats* merged;
+		int published_total[board::size_x * board::size_y]; // what this thread has published
+		int published_win[board::size_x * board::size_y];
+		int foreign_total[board::size_x * board::size_y]; // what this thread has taken in from the others
+		int foreign_win[board::size_x * board::size_y];
+	};
+
 	class node : board {
 	public:
-		int win_cnt;
-		int total_cnt;
-		int place_pos;
-		//std::vector<node*> child;
-		std::unordered_map<int, node*> child;
-		node* parent;
-
-		node(const board& state, int m = -1): board(state), place_pos(m), win_cnt(0), total_cnt(0), parent(nullptr) {}
-
-		float win_rate(){
-			if(win_cnt == 0 && total_cnt == 0){
+		std::atomic<int> total_cnt;
+		int place_pos; // the move by which this position was first reached
+
+		// the proven result for the side to move here (MCTS-Solver): a side without legal moves has lost,
+		// a node is won if some move leads to a lost node, and lost if all moves lead to won nodes;
+		// it is set once, from unknown, and threads proving it at the same time arrive at the same result
+		enum { lost = -1, unknown = 0, won = 1 };
+		std::atomic<int> proof;
+
+		// children live in one block allocated at the first expansion, the legal moves are shuffled once there
+		// and slots [tried, child_cnt) are the untried moves still to be expanded, in that order;
+		// the statistics of slot k are kept by the parent so that the ucb scan only touches these arrays
+		//
+		// the counters are atomic so that all threads may search one shared tree (parallel=tree):
+		// the block is built by the thread that moves status from fresh to building, a slot is taken
+		// by incrementing tried, and its child is published once it is made; a thread that finds
+		// the block or a child not ready yet just treats the node as a leaf, so nobody ever waits
+		enum { fresh, building, built };
+		std::atomic<int> status;
+		int child_cnt;
+		std::atomic<int> tried;
+		int* child_move;
+		std::atomic<int>* child_win;
+		std::atomic<int>* child_total;
+		std::atomic<node*>* child;
+
+		node(const board& state, int m = -1): board(state), total_cnt(0), place_pos(m),
+			proof(state.legal_moves(state.info().who_take_turns).any() ? unknown : lost), status(fresh), child_cnt(0), tried(0), child_move(nullptr), child_win(nullptr), child_total(nullptr), child(nullptr) {}
+
+		float win_rate(int k){
+			int n = child_total[k].load(std::memory_order_relaxed);
+			if(n == 0){
 				return 0.0;
 			}
 			
-			return (float)win_cnt / total_cnt;
+			return (float)child_win[k].load(std::memory_order_relaxed) / n;
 		}
 
-		float ucb(float c){
-			if(parent->total_cnt == 0 || total_cnt == 0){
-				return win_rate();
+		int select_child(bool own, float c){
+			int total = total_cnt.load(std::memory_order_relaxed);
+			float log_total = total ? std::log(total) : 0;
+			float max_score = -std::numeric_limits<float>::max();
+			int best = -1;
+			for(int k = 0; k < child_cnt; ++k){
+				node* next = child[k].load(std::memory_order_acquire);
+				if(next == nullptr){
+					continue;
+				}
+				int proven = next->proof.load();
+				if(proven == lost){
+					return k; // a winning move
+				}
+				if(proven == won){
+					continue; // a losing move, solved subtrees are not searched any further
+				}
+				int n = child_total[k].load(std::memory_order_relaxed);
+				float q = n ? (float)child_win[k].load(std::memory_order_relaxed) / n : 0;
+				float u = n ? c * std::sqrt(log_total / n) : 0;
+				float tmp = (own ? q : 1 - q) + u;
+				if(tmp > max_score){
+					max_score = tmp;
+					best = k;
+				}
 			}
-			
-			return win_rate() + c * std::sqrt(std::log(parent->total_cnt) / total_cnt);
-		}
 
-		float ucb_opponent(float c){
-			if(parent->total_cnt == 0 || total_cnt == 0){
-				return 1 - win_rate();
-			}
+			return best;
+		}
 
-			return (1 - win_rate()) + c * std::sqrt(std::log(parent->total_cnt) / total_cnt);
+		/**
+		 * count a visit of slot k right away, with a virtual loss that keeps other threads
+		 * off this path until back_propagate replaces it with the real result
+		 */
+		void visit(int k, bool own){
+			child_total[k].fetch_add(1, std::memory_order_relaxed);
+			child_win[k].fetch_add(own ? 0 : 1, std::memory_order_relaxed);
+			child[k].load(std::memory_order_acquire)->total_cnt.fetch_add(1, std::memory_order_relaxed);
 		}
 
-		int MCTS(int N, std::default_random_engine& engine, float ucb_c){
+		int MCTS(int N, unsigned who, rng& engine, float ucb_c, playout& simulator, arena& pool, transposition<node>& table, const tree_limit& limit, const time_manager& timer, search_stats& stats, int threads = 1,
+			root_share* share = nullptr, int every = 0){
 			// 1. select  2. expand  3. simulate  4. back propagate
+			// the wins of (who) are counted, the owner of the tree, who is not to move at the root when pondering
+			// (threads) is the number of threads searching this tree together,
+			// (share) exchanges the root statistics with other trees every (every) iterations and at the end
 
 			// debug
 			//std::fstream debug("record.txt", std::ios::app);
 			
-			for(int i = 0; i < N; ++i){
+			for(int i = 0; N == 0 || i < N; ++i){
+				if(proof.load() != unknown){
+					if(share != nullptr){
+						share->merged->solved.store(true);
+					}
+					break; // solved, the best move is known
+				}
+				if(share != nullptr && share->merged->solved.load()){
+					break; // another tree has solved its root
+				}
+				// stop at the deadline, or once the best move is decided (checked every 64 iterations)
+				if(timer.bounded() && i > 0 && i % 64 == 0 && (timer.expired() || decided(timer.remaining(i, N) * threads))){
+					break;
+				}
+				if(share != nullptr && every > 0 && i > 0 && i % every == 0){
+					exchange(*share, true);
+				}
 				// select
 				//debug << "select" << std::endl;
-				std::vector<node*> path = select_root_to_leaf(info().who_take_turns, ucb_c);
+				stats.begin();
+				std::vector<int> slot; // slot[j] is the slot of path[j + 1] in the child block of path[j]
+				std::vector<node*> path = select_root_to_leaf(who, ucb_c, slot);
+				stats.lap(search_stats::select);
 				// expand
 				//debug << "expand" << std::endl;
 				node* leaf = path.back();
-				node* expand_node = leaf->expand_from_leaf(engine);
-				if(expand_node != leaf){
-					path.push_back(expand_node);
+				// a full tree is not expanded any more, the playout starts from the leaf itself;
+				// a tree searched by one thread has its table to itself, which then grows with the tree
+				if(threads == 1){
+					table.reserve(pool.count());
+				}
+				int k = leaf->proof.load() == unknown && !limit.full(pool) ? leaf->expand_from_leaf(engine, pool, table) : -1;
+				if(k != -1){
+					leaf->visit(k, who == leaf->info().who_take_turns);
+					path.push_back(leaf->child[k]);
+					slot.push_back(k);
 				}
+				stats.lap(search_stats::expand);
 				// simulate
 				//debug << "simulate" << std::endl;
-				unsigned winner = path.back()->simulate_winner(engine);
+				// a proven position needs no playout
+				unsigned winner = path.back()->proof.load() != unknown ? path.back()->proven_winner() : path.back()->simulate_winner(engine, simulator);
+				stats.lap(search_stats::simulate);
 				// backpropagate
 				//debug << "backpropagate" << std::endl;
-				back_propagate(path, winner);
+				back_propagate(path, slot, winner, who);
+				stats.lap(search_stats::backpropagate);
+				stats.iteration(slot.size(), k != -1);
 			}
 
 			//debug.close();
+			if(share != nullptr){
+				exchange(*share, false);
+			}
 			return select_action();
 		}
 
 		int select_action(){
-			// select child node who has the highest win rate (highest Q)
-			if(child.size() == 0){
-				return -1;
-			}
-
+			// select the most visited child (the robust child), which is what decided() settles; ties go to the highest win rate
+			int expanded = std::min<int>(tried, child_cnt);
 			float max_score = -std::numeric_limits<float>::max();
-			node* c;
-			for(auto &ch : child){
-				float tmp = ch.second->win_rate();
-				if(tmp > max_score){
+			int max_visits = -1;
+			int best = -1;
+			bool best_losing = false;
+			for(int k = 0; k < expanded; ++k){
+				node* c = child[k].load(std::memory_order_acquire);
+				if(c == nullptr){
+					continue;
+				}
+				int proven = c->proof.load();
+				if(proven == lost){
+					return child_move[k]; // wins by force
+				}
+				bool losing = proven == won; // a proven losing move is only played when all moves lose
+				int visits = child_total[k].load(std::memory_order_relaxed);
+				float tmp = win_rate(k);
+				bool better = visits > max_visits || (visits == max_visits && tmp > max_score);
+				if(best == -1 || (best_losing && !losing) || (losing == best_losing && better)){
 					max_score = tmp;
-					c = ch.second;
+					max_visits = visits;
+					best = k;
+					best_losing = losing;
 				}
 			}
 			
-			return c->place_pos;
+			return best != -1 ? child_move[best] : -1;
 		}
 
-		std::vector<node*> select_root_to_leaf(unsigned who, float ucb_c){
+		std::vector<node*> select_root_to_leaf(unsigned who, float ucb_c, std::vector<int>& slot){
 			std::vector<node*> vec;
 			node* curr = this;
 			vec.push_back(curr);
-			while(!curr->is_leaf()){
-				// select node who has the highest ucb score
-				float max_score = -std::numeric_limits<float>::max();
-				node* c;
-				if(curr->child.size() == 0){
+			total_cnt.fetch_add(1, std::memory_order_relaxed);
+
+			while(curr->proof.load() == unknown && !curr->is_leaf()){
+				// select child who has the highest ucb score
+				bool own = who == curr->info().who_take_turns;
+				int k = curr->select_child(own, ucb_c);
+				if(k == -1){
+					curr->solve(); // all its expanded moves are proven to lose
 					break;
 				}
-				for(auto &curr_child : curr->child){
-					float tmp;
-					if(who == curr->info().who_take_turns){
-						tmp = (curr_child.second)->ucb(ucb_c);
-					}else{
-						tmp = (curr_child.second)->ucb_opponent(ucb_c);
-					}
-					if(tmp > max_score){
-						max_score = tmp;
-						c = curr_child.second;
-					}
-
-				}
-				vec.push_back(c);
-				curr = c;
+				curr->visit(k, own);
+				curr = curr->child[k];
+				vec.push_back(curr);
+				slot.push_back(k);
 			}
 
 			return vec;
 		}
 
-		bool is_leaf(){
-			int cnt = 0;
-			for(int i = 0; i < 81; i++){
-				if(board(*this).place(i) == board::legal){
-					cnt++;
+		void exchange(root_share& share, bool take){
+			int expanded = std::min<int>(tried, child_cnt);
+			for(int k = 0; k < expanded; ++k){
+				int m = child_move[k];
+				int own_total = child_total[k] - share.foreign_total[m];
+				int own_win = child_win[k] - share.foreign_win[m];
+				share.merged->total[m].fetch_add(own_total - share.published_total[m]);
+				share.merged->win[m].fetch_add(own_win - share.published_win[m]);
+				share.published_total[m] = own_total;
+				share.published_win[m] = own_win;
+				if(take){
+					int foreign_total = share.merged->total[m] - own_total;
+					int foreign_win = share.merged->win[m] - own_win;
+					child_total[k].fetch_add(foreign_total - share.foreign_total[m], std::memory_order_relaxed);
+					child_win[k].fetch_add(foreign_win - share.foreign_win[m], std::memory_order_relaxed);
+					total_cnt.fetch_add(foreign_total - share.foreign_total[m], std::memory_order_relaxed);
+					share.foreign_total[m] = foreign_total;
+					share.foreign_win[m] = foreign_win;
 				}
 			}
-			// check if fully expanded (leaf == not fully expanded)
-			return !(cnt > 0 && child.size() == cnt);
 		}
 
-		node* expand_from_leaf(std::default_random_engine& engine){
-			board b = *this;
-			std::vector<int> vec = all_space(engine);
-			bool success_placed = 0;
-			int pos = -1;
-
-			for(int i = 0; i < vec.size(); ++i){
-				b = *this;
-				if(b.place(vec[i]) == board::legal && (*this).child.count(vec[i]) == 0){
-					pos = vec[i];
-					success_placed = 1;
-					break;
+		bool decided(long remaining){
+			// the most visited move can no longer be overtaken by the iterations still to come
+			int expanded = std::min<int>(tried, child_cnt);
+			int first = 0, second = 0;
+			for(int k = 0; k < expanded; ++k){
+				int n = child_total[k].load(std::memory_order_relaxed);
+				if(n > first){
+					second = first;
+					first = n;
+				}else if(n > second){
+					second = n;
 				}
 			}
+			return first - second > remaining;
+		}
 
-			if(success_placed){
-				node* new_node = new node(b, pos);
-				//this->child.push_back(new_node);
-				this->child[pos] = new_node;
-				new_node->parent = this;
-				return new_node;
-			}else{
-				return this;
+		unsigned proven_winner() const {
+			return proof.load() == won ? info().who_take_turns : 3u - info().who_take_turns;
+		}
+
+		void solve(){
+			// prove this node from its children, it is lost only once all its moves are expanded and won;
+			// the proofs are sequentially consistent, so of two threads that prove the last two children
+			// at the same time, at least one sees both of them here
+			if(proof.load() != unknown || status.load(std::memory_order_acquire) != built){
+				return;
+			}
+			int expanded = std::min<int>(tried, child_cnt);
+			bool any_lost = false, all_won = expanded == child_cnt;
+			for(int k = 0; k < expanded && !any_lost; ++k){
+				node* c = child[k].load(std::memory_order_acquire);
+				int proven = c != nullptr ? c->proof.load() : int(unknown);
+				any_lost = proven == lost;
+				all_won = all_won && proven == won;
+			}
+			int expected = unknown;
+			if(any_lost || all_won){
+				proof.compare_exchange_strong(expected, any_lost ? won : lost);
 			}
 		}
 
-		unsigned simulate_winner(std::default_random_engine& engine){
-			board b = *this;
-			std::vector<int> vec = all_space(engine);
-			std::queue<int> q;
-			for(int i = 0; i < vec.size(); ++i){
-				q.push(vec[i]);
-			}
-
-			int cnt = 0;
-			while(cnt != q.size()){
-				int i = q.front();
-				q.pop();
-				if(b.place(i) != board::legal){
-					q.push(i);
-					cnt++;
-				}else{
-					cnt = 0;
+		/**
+		 * the move proven to win here, or -1; the moves proven to lose are marked in losing
+		 */
+		int proven_moves(bool* losing){
+			int expanded = status.load() == built ? std::min<int>(tried, child_cnt) : 0;
+			int win = -1;
+			for(int k = 0; k < expanded; ++k){
+				node* c = child[k].load();
+				int proven = c != nullptr ? c->proof.load() : int(unknown);
+				if(proven == lost){
+					win = child_move[k];
+				}else if(proven == won){
+					losing[child_move[k]] = true;
 				}
 			}
+			return win;
+		}
 
-			if(b.info().who_take_turns == board::white){
-				return board::black;
-			}else{
-				return board::white;
+		bool is_leaf(){
+			// check if fully expanded (leaf == not fully expanded)
+			return status.load(std::memory_order_acquire) != built || child_cnt == 0 || tried.load(std::memory_order_relaxed) < child_cnt;
+		}
+
+		void allocate_children(rng& engine, arena& pool){
+			bitboard legal = legal_moves(info().who_take_turns);
+			child_cnt = legal.count();
+			child_move = pool.make_array<int>(child_cnt);
+			child_win = pool.make_array<std::atomic<int>>(child_cnt);
+			child_total = pool.make_array<std::atomic<int>>(child_cnt);
+			child = pool.make_array<std::atomic<node*>>(child_cnt);
+			for(int k = 0; k < child_cnt; ++k){
+				child_move[k] = legal.pop_first();
 			}
+			engine.shuffle(child_move, child_move + child_cnt);
 		}
 
-		std::vector<int> all_space(std::default_random_engine& engine){
-			std::vector<int> vec;
-			for(int i = 0; i < 81; ++i){
-				vec.push_back(i);
+		int expand_from_leaf(rng& engine, arena& pool, transposition<node>& table){
+			if(status.load(std::memory_order_acquire) == fresh){
+				int expected = fresh;
+				if(!status.compare_exchange_strong(expected, building)){
+					return -1; // another thread is building the block
+				}
+				allocate_children(engine, pool);
+				status.store(built, std::memory_order_release);
 			}
-			std::shuffle(vec.begin(), vec.end(), engine);
-			return vec;
+			if(status.load(std::memory_order_acquire) != built || tried.load(std::memory_order_relaxed) >= child_cnt){
+				return -1;
+			}
+
+			// pop the next untried move, the position may be already in the tree through another move order
+			int k = tried.fetch_add(1);
+			if(k >= child_cnt){
+				return -1;
+			}
+			board b = *this;
+			b.place(child_move[k]);
+			node* n = table.find(b.hash());
+			if(n == nullptr || !n->same_position(b)){
+				node* made = pool.make<node>(b, child_move[k]);
+				n = table.insert(b.hash(), made);
+				if(!n->same_position(b)){
+					n = made;
+				}
+			}
+			child[k].store(n, std::memory_order_release);
+			return k;
+		}
+
+		bool same_position(const board& b) const {
+			return board::operator ==(b) && info().who_take_turns == b.info().who_take_turns;
 		}
 
-		void back_propagate(std::vector<node*>& path, unsigned winner){
-			for(int i = 0; i < path.size(); ++i){
-				path[i]->total_cnt++;
-				if(winner == info().who_take_turns){
-					path[i]->win_cnt++;
+		/**
+		 * the node of state below this one, reached along the moves played since, or nullptr if they leave the tree
+		 */
+		node* descendant(const board& state){
+			// stones are never removed in NoGo, so the moves played since are the stones state has on top of this position
+			node* n = this;
+			while(n != nullptr && !n->same_position(state)){
+				unsigned turn = n->info().who_take_turns;
+				bitboard played = state.stones(turn) & ~n->stones(turn);
+				int expanded = n->status.load() == built ? std::min<int>(n->tried, n->child_cnt) : 0;
+				node* next = nullptr;
+				for(int k = 0; k < expanded && next == nullptr; ++k){
+					if(played.test(n->child_move[k])){
+						next = n->child[k].load();
+					}
+				}
+				n = next;
+			}
+			return n;
+		}
+
+		node* copy_to(arena& pool, transposition<node>& table, std::unordered_map<const node*, node*>& copied, int keep = 0){
+			// a node shared by several move orders is copied only once, copied maps the nodes copied so far to their copies;
+			// an unproven move visited fewer than (keep) times is pruned, it is untried again and its subtree is dropped
+			node*& n = copied[this];
+			if(n != nullptr){
+				return n;
+			}
+			n = pool.make<node>(static_cast<const board&>(*this), place_pos);
+			n->total_cnt.store(total_cnt.load());
+			n->proof.store(proof.load());
+			table.insert(hash(), n);
+			if(status.load() == built){
+				n->child_cnt = child_cnt;
+				n->child_move = pool.make_array<int>(child_cnt);
+				n->child_win = pool.make_array<std::atomic<int>>(child_cnt);
+				n->child_total = pool.make_array<std::atomic<int>>(child_cnt);
+				n->child = pool.make_array<std::atomic<node*>>(child_cnt);
+				// the kept moves come first, then the pruned ones and the untried ones
+				int expanded = std::min<int>(tried, child_cnt), j = 0;
+				auto kept = [&](int k){
+					node* c = child[k].load();
+					return c != nullptr && (child_total[k].load() >= keep || c->proof.load() != unknown);
+				};
+				for(int k = 0; k < expanded; ++k){
+					node* c = child[k].load();
+					if(kept(k)){
+						n->child_move[j] = child_move[k];
+						n->child_win[j].store(child_win[k].load());
+						n->child_total[j].store(child_total[k].load());
+						n->child[j].store(c->copy_to(pool, table, copied, keep));
+						j++;
+					}
+				}
+				n->tried.store(j);
+				for(int k = 0; k < child_cnt; ++k){
+					if(k >= expanded || !kept(k)){
+						n->child_move[j++] = child_move[k];
+					}
 				}
+				n->status.store(built);
+			}
+			return n;
+		}
+
+		unsigned simulate_winner(rng& engine, playout& simulator){
+			return simulator(*this, engine);
+		}
+
+		void back_propagate(std::vector<node*>& path, std::vector<int>& slot, unsigned winner, unsigned who){
+			// the visits were already counted on the way down, only the virtual losses
+			// are replaced by the real results; the statistics of a move are kept in its slot of the parent
+			for(int i = 0; i < int(slot.size()); ++i){
+				node* n = path[i];
+				int result = winner == who ? 1 : 0;
+				int loss = n->info().who_take_turns == who ? 0 : 1;
+				n->child_win[slot[i]].fetch_add(result - loss, std::memory_order_relaxed);
+			}
+			// a proven result at the end of the path may prove its ancestors in turn
+			for(int i = int(slot.size()) - 1; i >= 0 && path[i + 1]->proof.load() != unknown; --i){
+				path[i]->solve();
 			}
 		}
 	};
 
-	void delete_tree(node* root){
-		if(root->child.size() == 0){
-			delete root;
-			return ;
+	/**
+	 * the root to search state from, which is taken from the tree of the last search when state is in it;
+	 * it is reached from tree, the root of that search, along the moves played since, and only looked up
+	 * by its hash when they left the tree; that subtree is copied into the spare arena and everything else is released,
+	 * and under a bound the subtree is pruned until it fits in half of limit and the spare chunks are freed;
+	 * tree is set to the new root
+	 */
+	node* reuse_root(const board& state, node*& tree, arena& pool, arena& spare, transposition<node>& table, const tree_limit& limit){
+		node* last = tree != nullptr ? tree->descendant(state) : nullptr;
+		if(last == nullptr){
+			last = table.find(state.hash());
 		}
+		if(last != nullptr && !last->same_position(state)){
+			last = nullptr;
+		}
+		node* root;
+		std::unordered_map<const node*, node*> copied;
+		table.reserve(pool.count()); // room for the whole last tree, of which a part is copied
+		tree_limit half = limit.part(0.5);
+		for(int keep = 0; ; keep = keep ? keep * 3 / 2 : 2){
+			spare.reset();
+			table.clear();
+			copied.clear();
+			if(last != nullptr){
+				root = last->copy_to(spare, table, copied, keep);
+			}else{
+				root = spare.make<node>(state);
+				table.insert(state.hash(), root);
+			}
+			// prune the moves visited fewer than keep times, raising keep by half until the subtree fits
+			if(last == nullptr || !half.full(spare) || keep > last->total_cnt){
+				break;
+			}
+		}
+		std::swap(pool, spare);
+		if(limit.bounded()){
+			spare.release();
+		}else{
+			spare.reset();
+		}
+		tree = root;
+		return root;
+	}
 
-		for(auto &c : root->child){
-			if(c.second != nullptr){
-				delete_tree(c.second);
+	/**
+	 * search state with all threads for N iterations each (0 for no limit) or until clock expires,
+	 * return the shared root of tree parallelizing, or nullptr for root parallelizing, whose root
+	 * statistics are merged through shares (one per thread, not merged when shares is nullptr)
+	 */
+	node* search(const board& state, int N, const time_manager& clock, std::vector<root_share>* shares = nullptr){
+		int thread_num = threads->size();
+		float c = meta["c"];
+		int every = meta["share"];
+		node* shared = nullptr;
+		tree_limit bound = limit.part(1.0 / thread_num); // what each thread may add to its arena
+		if(std::string(meta["parallel"]) == "tree"){
+			// tree parallelizing, the shared tree is kept in the arena and table of the first thread
+			shared = reuse_root(state, workers[0].tree, workers[0].pool, workers[0].spare, workers[0].table, limit);
+			for(int i = 1; i < thread_num; ++i){
+				workers[i].pool.reset();
+			}
+			bound = limit.less(workers[0].pool).part(1.0 / thread_num);
+			// the shared table cannot grow while the threads search, it is sized for N iterations of every thread,
+			// or for twice the nodes the last search added, on top of the kept tree
+			size_t adding = N ? size_t(N) * thread_num : 2 * added;
+			workers[0].table.reserve(workers[0].pool.count() + adding);
+		}
+		threads->run([&](int id){
+			worker& w = workers[id];
+			w.simulator.reset();
+			w.stats.reset();
+			if(shared != nullptr){
+				shared->MCTS(N, who, w.engine, c, w.simulator, w.pool, workers[0].table, id == 0 ? bound.above(w.pool) : bound, clock, w.stats, thread_num);
+			}else{
+				node* root = reuse_root(state, w.tree, w.pool, w.spare, w.table, bound);
+				root->MCTS(N, who, w.engine, c, w.simulator, w.pool, w.table, bound, clock, w.stats, 1, shares ? &(*shares)[id] : nullptr, every);
 			}
+		});
+		added = 0;
+		for(const worker& w : workers){
+			added += w.stats.nodes;
 		}
+		return shared;
+	}
 
-		delete root;
+	/**
+	 * start the search threads before the first search, threads=<n> (0 for one per hardware thread)
+	 * and pin=<cpu>,<cpu>,... to pin the i-th thread to the i-th listed CPU (not pinned by default);
+	 * each thread gets its own random stream, 2^128 numbers apart along this agent's engine,
+	 * so seed= fixes them all and no two of them overlap
+	 */
+	void start_workers(){
+		int thread_num = meta["threads"];
+		if(thread_num <= 0){
+			thread_num = std::max(int(std::thread::hardware_concurrency()), 1);
+		}
+		std::vector<int> cpus;
+		std::istringstream in(meta["pin"]);
+		for(std::string cpu; std::getline(in, cpu, ','); ){
+			if(cpu.size()){
+				cpus.push_back(std::stoi(cpu));
+			}
+		}
+		workers.resize(thread_num);
+		for(worker& w : workers){
+			engine.jump();
+			w.engine = engine;
+		}
+		threads.reset(new thread_pool(thread_num, cpus));
 	}
 
 private:
+	/**
+	 * what a search thread owns, only the shared tree of tree parallelizing lives in the first one
+	 */
+	struct worker {
+		rng engine;
+		playout simulator;
+		arena pool;
+		arena spare;
+		transposition<node> table;
+		node* tree = nullptr; // the root of the last search, in pool
+		search_stats stats;
+	};
+
 	std::vector<action::place> space;
 	board::piece_type who;
+	playout simulator;
+	time_manager timer;
+	time_manager ponder_timer; // bounds a background search by ponder=<seconds>
+	tree_limit limit; // bounds the trees by max_nodes=<nodes> and max_mem=<megabytes>, summed over the threads
+	solver endgame;
+	search_stats stats; // of the last search
+	std::vector<worker> workers; // one per thread
+	size_t added = 0; // nodes the threads added in the last search, to size the shared table for the next one
+	std::unique_ptr<thread_pool> threads;
+	std::thread ponder_thread;
 };
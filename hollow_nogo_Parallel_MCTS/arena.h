@@ -0,0 +1,100 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * arena.h: Define the bump allocator used for search trees
+ *
+ * objects are carved out of large chunks one after another and are never freed one by one;
+ * reset() releases everything at once in constant time and keeps the chunks for the next search
+ * (release() gives them back to the system instead, for a tree under a memory bound),
+ * so only trivially destructible objects may be created here;
+ * like board.h and the rest of the framework, each variant directory keeps its own copy so that it builds
+ * on its own, and the copies are identical, a change to one goes to all of them
+ */
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+
+class arena {
+public:
+	arena(size_t chunk = 1 << 20) : chunk(chunk), block(0), offset(0), spent(0), made(0) {}
+	arena(arena&& a) = default;
+	arena& operator =(arena&& a) = default;
+	arena(const arena&) = delete;
+	arena& operator =(const arena&) = delete;
+
+	/**
+	 * allocate uninitialized memory of given size and alignment
+	 */
+	void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+		while (true) {
+			if (block == chunks.size()) {
+				chunks.emplace_back(new char[std::max(chunk, size)]);
+				sizes.push_back(std::max(chunk, size));
+			}
+			size_t start = (offset + align - 1) & ~(align - 1);
+			if (start + size <= sizes[block]) {
+				offset = start + size;
+				return chunks[block].get() + start;
+			}
+			spent += sizes[block++];
+			offset = 0;
+		}
+	}
+
+	/**
+	 * construct an object, or a value-initialized array of n objects
+	 */
+	template<typename type, typename... args>
+	type* make(args&&... a) {
+		static_assert(std::is_trivially_destructible<type>::value, "arena never runs destructors");
+		made++;
+		return new (allocate(sizeof(type), alignof(type))) type(std::forward<args>(a)...);
+	}
+	template<typename type>
+	type* make_array(size_t n) {
+		static_assert(std::is_trivially_destructible<type>::value, "arena never runs destructors");
+		type* p = static_cast<type*>(allocate(sizeof(type) * n, alignof(type)));
+		for (size_t i = 0; i < n; i++) new (p + i) type();
+		return p;
+	}
+
+	/**
+	 * release all objects at once, the chunks are kept for reuse
+	 */
+	void reset() { block = 0; offset = 0; spent = 0; made = 0; }
+
+	/**
+	 * release all objects and free the chunks
+	 */
+	void release() {
+		reset();
+		chunks.clear();
+		sizes.clear();
+	}
+
+	/**
+	 * bytes handed out since the last reset, and bytes held by the chunks
+	 */
+	size_t used() const { return spent + offset; }
+	size_t reserved() const {
+		size_t total = 0;
+		for (size_t size : sizes) total += size;
+		return total;
+	}
+
+	/**
+	 * objects constructed by make() since the last reset, the arrays are not counted
+	 */
+	size_t count() const { return made; }
+
+private:
+	size_t chunk;
+	std::vector<std::unique_ptr<char[]>> chunks;
+	std::vector<size_t> sizes;
+	size_t block, offset, spent;
+	size_t made;
+};
@@ -86,15 +86,28 @@ int main(int argc, const char* argv[]) {
 			white.close_episode(win.name());
 		}
 	} else { // launch GTP shell
+		agent* searched = &black; // the player of the last genmove
+		// whether args[first...] are all numbers, as the time commands expect
+		auto numbers = [](const std::vector<std::string>& args, size_t first) {
+			for (size_t i = first; i < args.size(); i++) {
+				std::istringstream in(args[i]);
+				double value;
+				if (!(in >> value) || !in.eof()) return false;
+			}
+			return true;
+		};
 		for (std::string command; std::getline(std::cin, command); ) {
 			if (command.back() == '\r') command.pop_back();
 			if (command.empty()) continue;
+			black.stop_pondering(); // a new command ends the background search after our last move
+			white.stop_pondering();
 
 			std::vector<std::string> args;
 			std::istringstream iss(command);
 			for (std::string s; getline(iss, s, ' '); args.push_back(s));
 
 			std::string reply;
+			std::string status = "="; // "?" for a command that fails
 			if (args[0] == "play" || args[0] == "genmove") { // play a move, or generate a move and play
 				if (!stat.is_episode_ongoing()) { // should open an episode
 					black.open_episode("~:" + white.name());
@@ -136,9 +149,11 @@ int main(int argc, const char* argv[]) {
 						break;
 					}
 				} else if (args[0] == "genmove") { // generate a move and play
+					searched = &who;
 					action::place move = who.take_action(game.state());
 					if (game.apply_action(move) == true) {
 						reply = move.position();
+						who.ponder(game.state());
 					} else { // I have no legal move to play
 						reply = "resign";
 					}
@@ -166,6 +181,29 @@ int main(int argc, const char* argv[]) {
 				}
 				if (size > board::size_x || size > board::size_y) break;
 
+			} else if (args[0] == "time_settings") { // set the main time and byo-yomi of both players
+				if (args.size() != 4 || !numbers(args, 1)) {
+					status = "?";
+					reply = "syntax error";
+				} else {
+					std::string settings = args[1] + " " + args[2] + " " + args[3];
+					black.notify("time_settings=" + settings);
+					white.notify("time_settings=" + settings);
+				}
+
+			} else if (args[0] == "time_left") { // update the remaining time of a player
+				if (args.size() != 4 || args[1].empty() || std::string("bBwW").find(args[1][0]) == std::string::npos || !numbers(args, 2)) {
+					status = "?";
+					reply = "syntax error";
+				} else {
+					player& who = std::tolower(args[1][0]) == 'b' ? black : white;
+					who.notify("time_left=" + args[2] + " " + args[3]);
+				}
+
+			} else if (args[0] == "search_stats") { // report the statistics of the last search of a player
+				agent& who = args.size() < 2 ? *searched : std::tolower(args[1][0]) == 'w' ? white : black;
+				reply = "\n" + who.property("search_stats");
+
 			} else if (args[0] == "name") { // report the name of the program
 				reply = name;
 			} else if (args[0] == "version") { // report the version number of the program
@@ -173,13 +211,13 @@ int main(int argc, const char* argv[]) {
 			} else if (args[0] == "protocol_version") { // report GTP protocol version
 				reply = "2";
 			} else if (args[0] == "list_commands") { // print supported commands
-				reply = "play\n" "genmove\n" "clear_board\n" "showboard\n" "boardsize\n"
+				reply = "play\n" "genmove\n" "clear_board\n" "showboard\n" "boardsize\n" "time_settings\n" "time_left\n" "search_stats\n"
 				        "name\n" "version\n" "protocol_version\n" "list_commands\n" "quit\n";
 			} else {
 				reply = "unknown command";
 			}
 
-			std::cout << "= " << reply << std::endl << std::endl;
+			std::cout << status << " " << reply << std::endl << std::endl;
 		}
 	}
 
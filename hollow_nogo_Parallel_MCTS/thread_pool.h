@@ -0,0 +1,103 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * thread_pool.h: Define the persistent worker threads of the parallel search
+ *
+ * the workers are started once and sleep between searches, run(task) calls task(id) on every worker
+ * with id = 0, 1, ..., size() - 1 and returns after all of them are done;
+ * a worker may be pinned to a CPU so that it is not migrated between cores during a search
+ */
+
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <cstddef>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+class thread_pool {
+public:
+	/**
+	 * start n workers, worker i is pinned to cpus[i % cpus.size()] if cpus is not empty
+	 */
+	thread_pool(int n, const std::vector<int>& cpus = {}) : task(nullptr), round(0), busy(0), quit(false) {
+		for (int id = 0; id < n; id++) {
+			workers.emplace_back(&thread_pool::work, this, id);
+			if (cpus.size()) pin(workers.back(), cpus[id % cpus.size()]);
+		}
+	}
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : workers) t.join();
+	}
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator =(const thread_pool&) = delete;
+
+	/**
+	 * run the task on every worker and wait for all of them
+	 */
+	void run(const std::function<void(int)>& f) {
+		std::unique_lock<std::mutex> lock(mutex);
+		task = &f;
+		busy = workers.size();
+		round++;
+		wake.notify_all();
+		done.wait(lock, [this]() { return busy == 0; });
+		task = nullptr;
+	}
+
+	int size() const { return workers.size(); }
+
+private:
+	void work(int id) {
+		size_t seen = 0;
+		while (true) {
+			const std::function<void(int)>* f;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return quit || round != seen; });
+				if (quit) return;
+				seen = round;
+				f = task;
+			}
+			(*f)(id);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--busy == 0) done.notify_one();
+			}
+		}
+	}
+
+	/**
+	 * a CPU past the last one wraps around (cpu % hardware_concurrency()), a negative one is rejected with a warning;
+	 * a CPU that is not allowed for this process leaves the worker unpinned
+	 */
+	static bool pin(std::thread& t, int cpu) {
+		int n = std::thread::hardware_concurrency();
+		if (cpu >= 0 && n > 0) cpu %= n;
+		if (cpu < 0 || cpu >= CPU_SETSIZE) {
+			std::cerr << "cannot pin a thread to CPU " << cpu << ", it is left unpinned" << std::endl;
+			return false;
+		}
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) == 0;
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(int)>* task;
+	size_t round;
+	size_t busy;
+	bool quit;
+};